@@ -33,6 +33,24 @@ void *memset(void *buf, char c, size_t n) {
   return buf;
 }
 
+/**
+ * @brief 두 메모리 영역의 내용을 비교
+ *
+ * @param s1 비교할 메모리 영역 1
+ * @param s2 비교할 메모리 영역 2
+ * @param n 비교할 바이트 수
+ * @return int 두 영역이 같으면 0, 다르면 처음 다른 바이트의 차이
+ */
+int memcmp(const void *s1, const void *s2, size_t n) {
+  const uint8_t *p1 = (const uint8_t *)s1;
+  const uint8_t *p2 = (const uint8_t *)s2;
+  for (; n > 0; n--, p1++, p2++) {
+    if (*p1 != *p2)
+      return *p1 - *p2;
+  }
+  return 0;
+}
+
 /**
  * @brief 문자열 복사
  *
@@ -13,6 +13,34 @@ typedef uint32_t size_t;
 #define SYS_EXIT 3
 #define SYS_READFILE 4
 #define SYS_WRITEFILE 5
+#define SYS_KSTATS 6
+#define SYS_FSYNC 7
+#define SYS_UNLINK 8
+#define SYS_OPEN 9
+#define SYS_READ 10
+#define SYS_WRITE 11
+#define SYS_LSEEK 12
+#define SYS_CLOSE 13
+#define SYS_MMAP 14
+#define SYS_MSYNC 15
+#define SYS_MUNMAP 16
+#define SYS_FORK 17
+#define SYS_SPAWN 18
+#define SYS_WAIT 19
+#define SYS_TIMESLICE 20
+
+// open 플래그
+#define O_CREAT 1 // 파일이 없으면 새로 만듦
+#define O_TRUNC 2 // 파일 크기를 0으로 자름
+
+// mmap 보호 플래그 (쓰기 가능한 매핑의 변경 내용은 파일에 반영됨)
+#define PROT_READ 1  // 읽기 가능
+#define PROT_WRITE 2 // 쓰기 가능
+
+// lseek 기준 위치
+#define SEEK_SET 0 // 파일의 처음
+#define SEEK_CUR 1 // 현재 오프셋
+#define SEEK_END 2 // 파일의 끝
 
 // 물리 메모리 주소를 나타내는 타입 (pysical memory address)
 typedef uint32_t paddr_t;
@@ -40,6 +68,7 @@ typedef uint32_t vaddr_t;
 // 메모리 조작 함수들
 void *memset(void *buf, char c, size_t n);
 void *memcpy(void *dst, const void *src, size_t n);
+int memcmp(const void *s1, const void *s2, size_t n);
 
 // 문자열 조작 함수들
 char *strcpy(char *dst, const char *src);
@@ -0,0 +1,4 @@
+#include "user.h"
+
+// 셸의 spawn 명령으로 디스크에서 읽어 실행하는 예제 프로그램
+void main(void) { printf("Hello from spawned process!\n"); }
@@ -5,32 +5,59 @@ typedef unsigned char uint8_t; // 0 ~ 2^8-1 (255)
 typedef unsigned int uint32_t; // 0 ~ 2^32-1
 typedef uint32_t size_t;
 
-#define PROCS_MAX 8     // 최대 프로세스 개수
+#define PROCS_MAX 512   // 최대 프로세스 개수 (커널 스택 영역의 칸 수)
 #define PROC_UNUSED 0   // 사용되지 않는 프로세스 구조체
 #define PROC_RUNNABLE 1 // 실행 가능한 프로세스
+#define PROC_BLOCKED 3  // 대기 큐에서 이벤트를 기다리는 프로세스
 
 extern struct file files[FILES_MAX];
-extern uint8_t disk[DISK_MAX_SIZE];
+extern unsigned blk_capacity;
+extern struct sched_stats sched_stats;
 void read_write_disk(void *buf, unsigned sector, int is_write);
+void read_write_disk_batch(uint8_t *buf, unsigned sector, unsigned count,
+                           int is_write);
+struct blk_request *blk_submit_sg(unsigned sector, struct blk_seg *segs,
+                                  int nsegs, int is_write);
+bool blk_can_submit(unsigned ndescs);
+unsigned blk_descs_needed(uint32_t len);
+extern unsigned blk_max_sectors;
+void virtio_blk_intr(void);
+void blk_dump_stats(void);
+void blk_wait(void);
+bool blk_complete(struct blk_request *r);
+struct blk_request *blk_read_async(void *buf, unsigned sector, unsigned count,
+                                   void (*on_done)(struct blk_request *r),
+                                   void *ctx);
+struct buf *bread(unsigned sector);
+struct buf *bget(unsigned sector);
+void bdirty(struct buf *b);
+void brelse(struct buf *b);
+void bflush(void);
+void binval(unsigned sector);
+void bcache_dump_stats(void);
+void fs_timer_tick(void);
+uint32_t fs_reclaim(uint32_t n);
 
-struct process procs[PROCS_MAX]; // 모든 프로세스 제어 구조체 배열
+struct process *proc_orphans; // 회수해 줄 부모가 없는 종료된 프로세스 목록
+int proc_next_pid;            // 마지막으로 할당한 pid
 struct process *current_proc;    // 현재 실행 중인 프로세스
 struct process *idle_proc;       // Idle 프로세스
+uint32_t *kernel_page_table;     // 모든 프로세스가 공유하는 커널 매핑 원본
 struct virtio_virtq *virtq_init(unsigned index);
 
 extern char __kernel_base[];
 extern char __free_ram[], __free_ram_end[];
 
-// shell.bin.o에 포함된 원시 바이너리 사용
-extern char _binary_shell_bin_start[], _binary_shell_bin_size[];
+// shell.elf.o에 포함된 셸의 ELF 실행 파일 사용
+extern char _binary_shell_elf_start[], _binary_shell_elf_size[];
 
 // 사용자 모드 진입 함수
 __attribute__((naked)) void user_entry(void) {
   __asm__ __volatile__(
-      /* sepc(Supervisor Exception Program Counter) 레지스터에 USER_BASE 값을 씀
+      /* sepc(Supervisor Exception Program Counter) 레지스터에 시작 주소를 씀
        * 이 레지스터는 sret 명령어 실행 시 프로그램이 돌아갈 주소를 지정
-       * 즉, 사용자 프로그램(USER_BASE 주소)으로 점프 */
-      "csrw sepc, %[sepc] \n"
+       * 즉, 사용자 프로그램의 시작 주소(create_process가 s0에 넣어 둠)로 점프 */
+      "csrw sepc, s0 \n"
 
       /* sstatus(Supervisor Status) 레지스터에 SSTATUS_SPIE 값을 씀
        * SSTATUS_SPIE는 인터럽트 활성화 상태와 관련된 비트 */
@@ -40,28 +67,280 @@ __attribute__((naked)) void user_entry(void) {
        * 특권 모드에서 사용자 모드로 전환 */
       "sret \n"
       :
-      : [sepc] "r"(USER_BASE), [sstatus] "r"(SSTATUS_SPIE | SSTATUS_SUM));
+      : [sstatus] "r"(SSTATUS_SPIE | SSTATUS_SUM));
 }
 
-/** Bump Allocator / Linear Allocator
- * @brief  메모리 할당 함수, (메모리 해제 기능 없음)
+struct page *page_map;                       // 페이지별 메타데이터 배열
+paddr_t page_base;                           // 관리 영역의 첫 페이지 주소
+struct page *free_lists[PAGE_ORDER_MAX + 1]; // order별 free list
+struct page_stats page_stats;                // 페이지 할당자 통계
+
+// 페이지 번호(page_base 기준) <-> 메타데이터/물리 주소 변환
+static inline uint32_t page_index(struct page *pg) { return pg - page_map; }
+static inline paddr_t page_to_paddr(struct page *pg) {
+  return page_base + page_index(pg) * PAGE_SIZE;
+}
+static inline struct page *paddr_to_page(paddr_t paddr) {
+  return &page_map[(paddr - page_base) / PAGE_SIZE];
+}
+
+// order별 free list에 블록을 추가
+void free_list_push(struct page *pg, uint32_t order) {
+  pg->order = order;
+  pg->flags |= PG_FREE;
+  pg->prev = NULL;
+  pg->next = free_lists[order];
+  if (pg->next)
+    pg->next->prev = pg;
+  free_lists[order] = pg;
+  page_stats.free_blocks[order]++;
+}
+
+// order별 free list에서 블록을 제거 (이중 연결 리스트이므로 O(1))
+void free_list_remove(struct page *pg) {
+  if (pg->prev)
+    pg->prev->next = pg->next;
+  else
+    free_lists[pg->order] = pg->next;
+  if (pg->next)
+    pg->next->prev = pg->prev;
+  pg->next = pg->prev = NULL;
+  pg->flags &= ~PG_FREE;
+  page_stats.free_blocks[pg->order]--;
+}
+
+/**
+ * @brief 2^order 크기의 블록을 해제하고, 짝 블록이 비어 있으면 계속 병합
+ *
+ * @param idx 블록의 첫 페이지 번호
+ * @param order 블록의 order
+ */
+void free_block(uint32_t idx, uint32_t order) {
+  while (order < PAGE_ORDER_MAX) {
+    uint32_t buddy = idx ^ (1u << order);
+    if (buddy + (1u << order) > page_stats.total_pages)
+      break;
+
+    // 짝 블록이 같은 크기로 free list에 있을 때만 병합 가능
+    struct page *bp = &page_map[buddy];
+    if (!(bp->flags & PG_FREE) || bp->order != order)
+      break;
+
+    free_list_remove(bp);
+    idx &= ~(1u << order);
+    order++;
+  }
+
+  free_list_push(&page_map[idx], order);
+}
+
+/**
+ * @brief [idx, idx + n) 범위를 정렬된 2의 거듭제곱 블록들로 쪼개어 해제
+ * 할당 시 남는 꼬리 부분을 돌려주거나, 임의 개수 페이지를 해제할 때 사용
+ */
+void free_range(uint32_t idx, uint32_t n) {
+  while (n > 0) {
+    uint32_t order = 0;
+    while (order < PAGE_ORDER_MAX && (idx & (1u << order)) == 0 &&
+           (2u << order) <= n)
+      order++;
+
+    free_block(idx, order);
+    idx += 1u << order;
+    n -= 1u << order;
+  }
+}
+
+/**
+ * @brief 페이지 할당자 초기화
+ * __free_ram 영역의 앞부분에 페이지 메타데이터 배열을 두고,
+ * 나머지 페이지를 가능한 큰 블록 단위로 free list에 등록
+ */
+void pages_init(void) {
+  uint32_t n = ((paddr_t)__free_ram_end - (paddr_t)__free_ram) / PAGE_SIZE;
+  uint32_t meta_pages =
+      align_up(n * sizeof(struct page), PAGE_SIZE) / PAGE_SIZE;
+
+  page_map = (struct page *)__free_ram;
+  page_base = (paddr_t)__free_ram + meta_pages * PAGE_SIZE;
+  memset(page_map, 0, meta_pages * PAGE_SIZE);
+
+  page_stats.total_pages = n - meta_pages;
+  page_stats.free_pages = page_stats.total_pages;
+  free_range(0, page_stats.total_pages);
+}
+
+/** Buddy Allocator
+ * @brief 연속된 물리 페이지를 할당하고 0으로 초기화
+ * n을 담을 수 있는 가장 작은 블록을 찾아 필요한 만큼 쪼개고,
+ * n이 2의 거듭제곱이 아니면 남는 꼬리 페이지는 즉시 free list로 반환
  *
  * @param n 할당할 페이지 수
- * @return paddr_t 할당된 메모리 주소
+ * @return paddr_t 할당된 메모리 주소 (회수해도 연속된 빈 페이지가 없으면 0)
  */
-paddr_t alloc_pages(uint32_t n) {
-  static paddr_t next_paddr = (paddr_t)__free_ram;
-  paddr_t paddr = next_paddr;
-  // 링커 스크립트에서 ALIGN(4096)으로 정렬되어 있음
-  next_paddr += n * PAGE_SIZE;
+paddr_t try_alloc_pages(uint32_t n) {
+  uint32_t order = 0;
+  while ((1u << order) < n)
+    order++;
+  if (order > PAGE_ORDER_MAX)
+    return 0;
 
-  if (next_paddr > (paddr_t)__free_ram_end)
-    PANIC("out of memory");
+  // 요청을 만족하는 가장 작은 free 블록 탐색. 없으면 페이지 캐시에서 깨끗한
+  // 페이지를 회수해 가며 다시 찾음
+  uint32_t cur;
+  for (;;) {
+    cur = order;
+    while (cur <= PAGE_ORDER_MAX && !free_lists[cur])
+      cur++;
+    if (cur <= PAGE_ORDER_MAX)
+      break;
+    if (!fs_reclaim(FS_RECLAIM_BATCH))
+      return 0;
+  }
+
+  struct page *pg = free_lists[cur];
+  free_list_remove(pg);
+  uint32_t idx = page_index(pg);
+
+  // 큰 블록을 반으로 나누며 뒤쪽 절반을 free list로 돌려줌
+  while (cur > order) {
+    cur--;
+    free_list_push(&page_map[idx + (1u << cur)], cur);
+  }
+
+  // 2^order 중 실제로 쓰지 않는 꼬리 페이지 반환
+  free_range(idx + n, (1u << order) - n);
+  pg->order = order;
+
+  page_stats.free_pages -= n;
+  page_stats.used_pages += n;
+  page_stats.alloc_calls++;
 
+  paddr_t paddr = page_to_paddr(pg);
   memset((void *)paddr, 0, n * PAGE_SIZE);
+  pg->refs = 1;
   return paddr;
 }
 
+// 연속된 물리 페이지를 할당 (실패하면 PANIC, 커널 내부 할당에 사용)
+paddr_t alloc_pages(uint32_t n) {
+  paddr_t paddr = try_alloc_pages(n);
+  if (!paddr)
+    PANIC("out of memory (%d pages)", n);
+  return paddr;
+}
+
+/**
+ * @brief alloc_pages로 할당한 페이지를 해제
+ *
+ * @param paddr 해제할 메모리 주소 (alloc_pages의 반환값)
+ * @param n 해제할 페이지 수 (할당 시의 페이지 수와 같아야 함)
+ */
+void free_pages(paddr_t paddr, uint32_t n) {
+  if (!is_aligned(paddr, PAGE_SIZE) || paddr < page_base ||
+      paddr + n * PAGE_SIZE > page_base + page_stats.total_pages * PAGE_SIZE)
+    PANIC("free_pages: invalid paddr %x", paddr);
+  if (paddr_to_page(paddr)->flags & PG_FREE)
+    PANIC("free_pages: double free %x", paddr);
+
+  free_range(page_index(paddr_to_page(paddr)), n);
+
+  page_stats.free_pages += n;
+  page_stats.used_pages -= n;
+  page_stats.free_calls++;
+}
+
+// 한 페이지를 공유하는 페이지 테이블이 하나 늘어남
+void page_get(paddr_t paddr) { paddr_to_page(paddr)->refs++; }
+
+// 페이지의 참조를 하나 내려놓고, 마지막 참조였으면 반환
+void page_put(paddr_t paddr) {
+  if (--paddr_to_page(paddr)->refs == 0)
+    free_pages(paddr, 1);
+}
+
+// slab 목록에 추가/삭제
+void slab_list_push(struct slab_cache *cache, struct slab *slab) {
+  slab->prev = NULL;
+  slab->next = cache->partial;
+  if (cache->partial)
+    cache->partial->prev = slab;
+  cache->partial = slab;
+}
+
+void slab_list_remove(struct slab_cache *cache, struct slab *slab) {
+  if (slab->prev)
+    slab->prev->next = slab->next;
+  else
+    cache->partial = slab->next;
+  if (slab->next)
+    slab->next->prev = slab->prev;
+}
+
+/**
+ * @brief slab에서 객체 하나를 할당 (0으로 초기화)
+ * 빈 객체가 남은 slab이 없으면 페이지를 하나 받아 객체들로 나눔
+ *
+ * @param cache 객체 크기별 slab 캐시
+ * @return void* 할당한 객체
+ */
+void *slab_alloc(struct slab_cache *cache) {
+  uint32_t size = align_up(cache->obj_size, 8);
+  uint32_t first = align_up(sizeof(struct slab), 8);
+  if (first + size > PAGE_SIZE)
+    PANIC("slab_alloc: too large object (%d bytes)", size);
+
+  struct slab *slab = cache->partial;
+  if (!slab) {
+    slab = (struct slab *)alloc_pages(1);
+    for (int i = (PAGE_SIZE - first) / size - 1; i >= 0; i--) {
+      void *obj = (uint8_t *)slab + first + i * size;
+      *(void **)obj = slab->free;
+      slab->free = obj;
+    }
+    slab_list_push(cache, slab);
+    cache->pages++;
+  }
+
+  void *obj = slab->free;
+  slab->free = *(void **)obj;
+  if (!slab->free)
+    slab_list_remove(cache, slab); // 가득 참
+  slab->used++;
+  cache->objs++;
+  memset(obj, 0, size);
+  return obj;
+}
+
+// slab_alloc으로 할당한 객체를 반환. 비어 버린 slab은 다른 slab에 빈 객체가
+// 남아 있으면 페이지를 반환 (할당/해제가 반복될 때 페이지를 매번 주고받지 않음)
+void slab_free(struct slab_cache *cache, void *obj) {
+  struct slab *slab = (struct slab *)((uint32_t)obj & ~(PAGE_SIZE - 1));
+  if (!slab->free)
+    slab_list_push(cache, slab); // 가득 차 있던 slab
+  *(void **)obj = slab->free;
+  slab->free = obj;
+  slab->used--;
+  cache->objs--;
+
+  if (slab->used == 0 && (slab->prev || slab->next)) {
+    slab_list_remove(cache, slab);
+    free_pages((paddr_t)slab, 1);
+    cache->pages--;
+  }
+}
+
+// 페이지 할당자 통계 출력, order별 free 블록 수로 단편화 정도를 확인
+void pages_dump_stats(void) {
+  printf("pages: total=%d free=%d used=%d (alloc=%d, free=%d)\n",
+         page_stats.total_pages, page_stats.free_pages, page_stats.used_pages,
+         page_stats.alloc_calls, page_stats.free_calls);
+  printf("pages: free blocks by order:");
+  for (int order = 0; order <= PAGE_ORDER_MAX; order++)
+    printf(" %d", page_stats.free_blocks[order]);
+  printf("\n");
+}
+
 /**
  * @brief 가상주소를 물리주소로 매핑하는 페이지 테이블 엔트리를 설정
  *
@@ -105,30 +384,314 @@ void map_page(uint32_t *table1, uint32_t vaddr, paddr_t paddr, uint32_t flags) {
 }
 
 /**
- * @brief 프로세스 생성, 지정된 크기만큼 실행된 이미지를 페이지 단위로 복사하여
- * 프로세스의 페이지 테이블에 매핑
+ * @brief 페이지 테이블을 따라가 가상 주소를 물리 주소로 변환
  *
- * @param image 실행 이미지의 포인터
- * @param image_size 이미지 크기
- * @return struct process* 생성된 프로세스 구조체의 주소
+ * @param table1 1단계 페이지 테이블의 포인터
+ * @param vaddr 변환할 가상 주소
+ * @return paddr_t 물리 주소 (매핑되어 있지 않으면 0)
  */
-struct process *create_process(const void *image, size_t image_size) {
-  // 미사용 상태의 프로세스 구조체 찾기
-  struct process *proc = NULL;
-  int i;
-  for (i = 0; i < PROCS_MAX; i++) {
-    // procs 배열에서 UNUSED 상태인 슬롯의 주소를 proc에 저장
-    if (procs[i].state == PROC_UNUSED) {
-      proc = &procs[i];
-      break;
+paddr_t virt_to_phys(uint32_t *table1, vaddr_t vaddr) {
+  uint32_t pte = table1[(vaddr >> 22) & 0x3ff];
+  if ((pte & PAGE_V) == 0)
+    return 0;
+
+  // 1단계 엔트리가 leaf이면 4MB 메가페이지
+  if (pte & (PAGE_R | PAGE_W | PAGE_X))
+    return (pte >> 10) * PAGE_SIZE + (vaddr & (MEGAPAGE_SIZE - 1));
+
+  uint32_t *table0 = (uint32_t *)((pte >> 10) * PAGE_SIZE);
+  pte = table0[(vaddr >> 12) & 0x3ff];
+  if ((pte & PAGE_V) == 0)
+    return 0;
+  return (pte >> 10) * PAGE_SIZE + (vaddr & (PAGE_SIZE - 1));
+}
+
+// vaddr에 해당하는 2단계 페이지 테이블 엔트리의 주소 (2단계 테이블이 없으면 NULL)
+uint32_t *page_table_entry(uint32_t *table1, vaddr_t vaddr) {
+  uint32_t pte = table1[(vaddr >> 22) & 0x3ff];
+  if ((pte & PAGE_V) == 0 || (pte & (PAGE_R | PAGE_W | PAGE_X)))
+    return NULL;
+
+  uint32_t *table0 = (uint32_t *)((pte >> 10) * PAGE_SIZE);
+  return &table0[(vaddr >> 12) & 0x3ff];
+}
+
+// vaddr에 대한 TLB 엔트리를 모든 ASID에서 무효화
+void tlb_flush_page(vaddr_t vaddr) {
+  __asm__ __volatile__("sfence.vma %[vaddr], zero" ::[vaddr] "r"(vaddr)
+                       : "memory");
+}
+
+/**
+ * @brief 모든 프로세스가 공유할 커널 페이지 테이블을 한 번만 구성
+ * 커널 영역(__kernel_base ~ __free_ram_end)은 4MB 메가페이지로 일대일 매핑하므로
+ * 2단계 테이블 없이 1단계 엔트리 몇 개로 끝남. 메가페이지는 4MB 정렬이 필요하므로
+ * 앞뒤를 4MB 경계로 넓혀서 매핑 (OpenSBI 영역은 PMP가 보호)
+ * 장치 레지스터처럼 4KB 단위로 매핑하는 영역의 2단계 테이블도 여기서 만들어
+ * 이후 모든 프로세스가 그대로 공유
+ */
+void kernel_vm_init(void) {
+  kernel_page_table = (uint32_t *)alloc_pages(1);
+
+  paddr_t start = (paddr_t)__kernel_base & ~(MEGAPAGE_SIZE - 1);
+  paddr_t end = align_up((paddr_t)__free_ram_end, MEGAPAGE_SIZE);
+  for (paddr_t paddr = start; paddr < end; paddr += MEGAPAGE_SIZE)
+    kernel_page_table[(paddr >> 22) & 0x3ff] = ((paddr / PAGE_SIZE) << 10) |
+                                               PAGE_R | PAGE_W | PAGE_X |
+                                               PAGE_G | PAGE_V;
+
+  // virtio 블록 디바이스의 메모리 영역도 커널 페이지 테이블에 매핑
+  map_page(kernel_page_table, VIRTIO_BLK_PADDR, VIRTIO_BLK_PADDR,
+           PAGE_R | PAGE_W | PAGE_G);
+
+  // UART와 PLIC 레지스터 (PLIC은 사용하는 페이지만 매핑)
+  map_page(kernel_page_table, UART0_PADDR, UART0_PADDR,
+           PAGE_R | PAGE_W | PAGE_G);
+  map_page(kernel_page_table, PLIC_PADDR, PLIC_PADDR, PAGE_R | PAGE_W | PAGE_G);
+  map_page(kernel_page_table, PLIC_SENABLE & ~(PAGE_SIZE - 1),
+           PLIC_SENABLE & ~(PAGE_SIZE - 1), PAGE_R | PAGE_W | PAGE_G);
+  map_page(kernel_page_table, PLIC_STHRESHOLD, PLIC_STHRESHOLD,
+           PAGE_R | PAGE_W | PAGE_G);
+
+  // 커널 스택 영역의 2단계 테이블을 미리 만들어 두어, 이후에 만든 스택도
+  // 1단계 엔트리를 복사해 둔 모든 프로세스의 주소 공간에 보이게 함
+  for (vaddr_t va = KSTACK_BASE; va < KSTACK_BASE + PROCS_MAX * KSTACK_STRIDE;
+       va += MEGAPAGE_SIZE)
+    kernel_page_table[(va >> 22) & 0x3ff] =
+        ((alloc_pages(1) / PAGE_SIZE) << 10) | PAGE_V;
+}
+
+uint32_t asid_max;        // 하드웨어가 지원하는 최대 ASID (0이면 미지원)
+uint32_t asid_generation; // 현재 ASID 세대
+uint32_t asid_next;       // 이번 세대에서 다음에 할당할 ASID
+struct tlb_stats tlb_stats;
+
+/**
+ * @brief 하드웨어가 지원하는 ASID 비트 수를 확인
+ * satp의 ASID 필드에 모두 1을 써본 뒤 다시 읽으면 구현된 비트만 1로 남음
+ * 커널 영역은 kernel_page_table에 일대일 매핑되어 있으므로 잠깐 켜도 안전
+ */
+void asid_init(void) {
+  uint32_t satp = SATP_SV32 | SATP_ASID_MASK |
+                  ((uint32_t)kernel_page_table / PAGE_SIZE);
+  __asm__ __volatile__("csrw satp, %[satp]\n"
+                       "sfence.vma\n"
+                       "csrr %[satp], satp\n"
+                       "csrw satp, zero\n"
+                       "sfence.vma\n"
+                       : [satp] "+r"(satp));
+
+  asid_max = (satp & SATP_ASID_MASK) >> SATP_ASID_SHIFT;
+  asid_generation = 1;
+  asid_next = 1; // ASID 0은 부팅 중의 커널이 사용
+  printf("asid: %d ASIDs available\n", asid_max);
+}
+
+/**
+ * @brief 프로세스의 주소 공간으로 전환
+ * 세대(generation) 방식의 ASID 할당: 프로세스의 asid가 현재 세대에 할당된 것이면
+ * satp만 바꾸고 TLB는 그대로 둠. ASID를 모두 소진하면 세대를 올리고 TLB 전체를
+ * 한 번 비운 뒤 1번부터 다시 할당 (이전 세대의 asid는 자동으로 무효가 됨)
+ * 커널 매핑은 PAGE_G(전역)이므로 ASID가 바뀌어도 TLB에 남아 있음
+ */
+void switch_address_space(struct process *proc) {
+  tlb_stats.switches++;
+
+  // ASID 미지원 하드웨어: 전환할 때마다 TLB 전체 무효화
+  if (asid_max == 0) {
+    __asm__ __volatile__("sfence.vma\n"
+                         "csrw satp, %[satp]\n"
+                         "sfence.vma\n"
+                         :
+                         : [satp] "r"(SATP_SV32 | ((uint32_t)proc->page_table /
+                                                   PAGE_SIZE)));
+    tlb_stats.full_flushes++;
+    return;
+  }
+
+  bool fresh = false;
+  if (proc->asid_gen != asid_generation) {
+    // ASID 고갈: 새 세대 시작
+    if (asid_next > asid_max) {
+      asid_generation++;
+      asid_next = 1;
+      __asm__ __volatile__("sfence.vma" ::: "memory");
+      tlb_stats.full_flushes++;
+      tlb_stats.rollovers++;
     }
+
+    proc->asid = asid_next++;
+    proc->asid_gen = asid_generation;
+    tlb_stats.asid_allocs++;
+    fresh = true;
+  }
+
+  uint32_t satp = SATP_SV32 | (proc->asid << SATP_ASID_SHIFT) |
+                  ((uint32_t)proc->page_table / PAGE_SIZE);
+  __asm__ __volatile__("csrw satp, %[satp]" ::[satp] "r"(satp));
+
+  // 새로 받은 ASID는 이번 세대에 쓰인 적이 없으므로 해당 ASID만 무효화하여
+  // 새 페이지 테이블 내용이 반영되도록 함 (전역 커널 엔트리는 유지)
+  if (fresh) {
+    __asm__ __volatile__("sfence.vma zero, %[asid]" ::[asid] "r"(proc->asid)
+                         : "memory");
+    tlb_stats.asid_flushes++;
+  }
+}
+
+// TLB/ASID 통계 출력
+void tlb_dump_stats(void) {
+  printf("tlb: switches=%d asid_allocs=%d asid_flushes=%d full_flushes=%d "
+         "rollovers=%d\n",
+         tlb_stats.switches, tlb_stats.asid_allocs, tlb_stats.asid_flushes,
+         tlb_stats.full_flushes, tlb_stats.rollovers);
+}
+
+// 우선순위별 실행 큐, 비트 i가 1이면 run_queues[i]가 비어 있지 않음
+struct proc_queue run_queues[PRIO_LEVELS];
+uint32_t run_queue_bitmap;
+
+// 큐의 맨 뒤에 프로세스 추가
+void proc_queue_push(struct proc_queue *q, struct process *proc) {
+  proc->next = NULL;
+  if (q->tail)
+    q->tail->next = proc;
+  else
+    q->head = proc;
+  q->tail = proc;
+}
+
+// 큐의 맨 앞에서 프로세스를 꺼냄 (비어 있으면 NULL)
+struct process *proc_queue_pop(struct proc_queue *q) {
+  struct process *proc = q->head;
+  if (proc) {
+    q->head = proc->next;
+    if (!q->head)
+      q->tail = NULL;
+    proc->next = NULL;
+  }
+  return proc;
+}
+
+// 실행 큐에 프로세스 추가
+void runqueue_add(struct process *proc, int prio) {
+  proc_queue_push(&run_queues[prio], proc);
+  run_queue_bitmap |= 1u << prio;
+}
+
+// 가장 높은 우선순위의 실행 큐에서 프로세스를 꺼냄
+// 비트맵의 최하위 1 비트를 찾으므로 프로세스 수와 무관하게 O(1)
+struct process *runqueue_pick(void) {
+  if (!run_queue_bitmap)
+    return NULL;
+
+  int prio = __builtin_ctz(run_queue_bitmap);
+  struct process *proc = proc_queue_pop(&run_queues[prio]);
+  if (!run_queues[prio].head)
+    run_queue_bitmap &= ~(1u << prio);
+  return proc;
+}
+
+// 대기 중인 프로세스를 깨워 실행 큐에 넣음 (PROC_BLOCKED -> PROC_RUNNABLE)
+void proc_wakeup(struct process *proc) {
+  proc->state = PROC_RUNNABLE;
+  runqueue_add(proc, proc->priority);
+}
+
+// 실행 큐에 현재 프로세스보다 우선순위가 높은 프로세스가 있는지 확인
+bool runqueue_has_higher(int prio) {
+  return (run_queue_bitmap & ((1u << prio) - 1)) != 0;
+}
+
+struct slab_cache proc_cache = {.obj_size = sizeof(struct process)};
+uint16_t kstack_free_slots[PROCS_MAX]; // 비어 있는 커널 스택 칸 번호
+uint32_t kstack_free_count;            // 비어 있는 커널 스택 칸 수
+
+// 커널 스택 칸을 모두 비어 있는 것으로 표시 (앞쪽 칸부터 사용)
+void proc_init(void) {
+  for (int i = 0; i < PROCS_MAX; i++)
+    kstack_free_slots[i] = PROCS_MAX - 1 - i;
+  kstack_free_count = PROCS_MAX;
+}
+
+// 칸의 가드 페이지 위에 커널 스택 페이지를 매핑
+void kstack_alloc(struct process *proc) {
+  proc->kstack_slot = kstack_free_slots[--kstack_free_count];
+  proc->kstack_paddr = alloc_pages(KSTACK_SIZE / PAGE_SIZE);
+  vaddr_t base = KSTACK_BASE + proc->kstack_slot * KSTACK_STRIDE + PAGE_SIZE;
+  for (uint32_t off = 0; off < KSTACK_SIZE; off += PAGE_SIZE)
+    map_page(kernel_page_table, base + off, proc->kstack_paddr + off,
+             PAGE_R | PAGE_W | PAGE_G);
+  proc->kstack_top = base + KSTACK_SIZE;
+}
+
+// 커널 스택의 매핑을 지우고 페이지와 칸을 반환
+void kstack_free(struct process *proc) {
+  vaddr_t base = proc->kstack_top - KSTACK_SIZE;
+  for (uint32_t off = 0; off < KSTACK_SIZE; off += PAGE_SIZE) {
+    *page_table_entry(kernel_page_table, base + off) = 0;
+    tlb_flush_page(base + off);
+  }
+  free_pages(proc->kstack_paddr, KSTACK_SIZE / PAGE_SIZE);
+  kstack_free_slots[kstack_free_count++] = proc->kstack_slot;
+}
+
+// 커널 스택 안의 주소(물리 주소, 일대일 매핑)를 스택 영역의 가상 주소로 변환
+// 부팅 중에는 페이징이 꺼져 있으므로 스택 내용은 물리 주소로 씀
+vaddr_t kstack_vaddr(struct process *proc, void *ptr) {
+  return proc->kstack_top - (proc->kstack_paddr + KSTACK_SIZE - (paddr_t)ptr);
+}
+
+// 종료된 프로세스의 남은 자원(1단계 페이지 테이블, 커널 스택, 제어 구조체)을
+// 반환. 사용자 페이지는 종료할 때 이미 반환됨. 현재 실행 중인 프로세스는 안 됨
+void proc_free(struct process *proc) {
+  free_pages((paddr_t)proc->page_table, 1);
+  kstack_free(proc);
+  slab_free(&proc_cache, proc);
+  sched_stats.reaps++;
+}
+
+// 부모 없이 종료된 프로세스를 회수
+void proc_reap_orphans(void) {
+  while (proc_orphans) {
+    struct process *proc = proc_orphans;
+    proc_orphans = proc->next;
+    proc_free(proc);
   }
+}
+
+// 새 프로세스 제어 구조체와 커널 스택을 할당 (칸이 모자라면 NULL)
+struct process *proc_alloc(void) {
+  proc_reap_orphans();
+  if (kstack_free_count == 0)
+    return NULL;
+
+  struct process *proc = slab_alloc(&proc_cache);
+  kstack_alloc(proc);
+  if (proc_cache.objs > sched_stats.peak_procs)
+    sched_stats.peak_procs = proc_cache.objs;
+  return proc;
+}
 
+/**
+ * @brief 프로세스 생성. 이미지는 복사하거나 매핑하지 않고 위치만 기록해 두며,
+ * 각 페이지는 처음 접근할 때 페이지 폴트에서 복사 (vm_fault 참고)
+ * 따라서 생성 비용은 이미지 크기와 관계없이 일정
+ *
+ * @param image 실행 이미지 (커널 스레드는 NULL)
+ * @param entry 첫 컨텍스트 스위치에서 돌아갈 커널 함수 (사용자 프로세스는
+ * user_entry). 부팅 중에는 페이징이 꺼져 있어 proc->sp로는 스택에 쓸 수
+ * 없으므로 초기 프레임은 여기서 물리 주소로 모두 구성
+ * @return struct process* 생성된 프로세스 구조체의 주소
+ */
+struct process *create_process(struct image *image, void (*entry)(void)) {
+  // 프로세스 제어 구조체와 커널 스택 할당
+  struct process *proc = proc_alloc();
   if (!proc)
     PANIC("no free process slots");
 
   // 커널 스택 초기화, 스택의 최상단(가장 높은 주소)부터 시작
-  uint32_t *sp = (uint32_t *)&proc->stack[sizeof(proc->stack)];
+  uint32_t *sp = (uint32_t *)(proc->kstack_paddr + KSTACK_SIZE);
 
   // 커널 스택에 callee-saved 레지스터 공간을 미리 준비
   // 첫 컨텍스트 스위치 시, switch_context에서 이 값들을 복원
@@ -143,41 +706,35 @@ struct process *create_process(const void *image, size_t image_size) {
   *--sp = 0;                    // s3
   *--sp = 0;                    // s2
   *--sp = 0;                    // s1
-  *--sp = 0;                    // s0
-  *--sp = (uint32_t)user_entry; // ra (처음 실행 시 점프할 주소)
+  *--sp = image ? image->entry : 0; // s0 (user_entry가 점프할 시작 주소)
+  *--sp = (uint32_t)entry;      // ra (처음 실행 시 점프할 주소)
 
+  // 커널 영역은 kernel_page_table의 1단계 엔트리만 복사 (2단계 테이블은 공유)
   uint32_t *page_table = (uint32_t *)alloc_pages(1);
-
-  // 커널 메모리 영역을 일대일 방식으로 매핑
-  for (paddr_t paddr = (paddr_t)__kernel_base; paddr < (paddr_t)__free_ram_end;
-       paddr += PAGE_SIZE)
-    map_page(page_table, paddr, paddr, PAGE_R | PAGE_W | PAGE_X);
-
-  // virtio 블록 디바이스의 메모리 영역도 프로세스 페이지 테이블에 매핑
-  map_page(page_table, VIRTIO_BLK_PADDR, VIRTIO_BLK_PADDR, PAGE_R | PAGE_W);
-
-  // 루프를 사용하여 이미지를 페이지 단위로 처리
-  for (uint32_t off = 0; off < image_size; off += PAGE_SIZE) {
-    // 새 물리 메모리 페이지 할당
-    paddr_t page = alloc_pages(1);
-
-    // 현재 오프셋에서 복사할 크기를 계산
-    size_t remaining = image_size - off;
-    size_t copy_size = PAGE_SIZE <= remaining ? PAGE_SIZE : remaining;
-
-    // 이미지 데이터를 새로 할당된 페이지에 복사
-    memcpy((void *)page, image + off, copy_size);
-
-    // 가상 메모리 주소를 물리 메모리에 매핑
-    map_page(page_table, USER_BASE + off, page,
-             PAGE_U | PAGE_R | PAGE_W | PAGE_X);
-  }
+  for (int vpn1 = 0; vpn1 < PAGE_SIZE / 4; vpn1++)
+    page_table[vpn1] = kernel_page_table[vpn1];
 
   // 구조체 필드 초기화
-  proc->pid = i + 1;
-  proc->state = PROC_RUNNABLE;
-  proc->sp = (uint32_t)sp;
+  // 부모, 파일 디스크립터, mmap 영역은 slab_alloc이 0으로 채워 비어 있음
+  proc->pid = ++proc_next_pid;
+  proc->priority = PRIO_DEFAULT;
+  proc->sp = kstack_vaddr(proc, sp);
   proc->page_table = page_table;
+  proc->image = image;
+  if (image)
+    image->refs++;
+
+  // 이미지가 없는 프로세스(idle)는 실행 큐에 넣지 않음
+  proc->state = PROC_RUNNABLE;
+  if (image)
+    runqueue_add(proc, proc->priority);
+  return proc;
+}
+
+// 커널 모드에서만 실행되는 스레드 생성 (사용자 이미지 없이 entry에서 시작)
+struct process *create_kernel_thread(void (*entry)(void)) {
+  struct process *proc = create_process(NULL, entry);
+  runqueue_add(proc, proc->priority);
   return proc;
 }
 
@@ -234,6 +791,47 @@ void putchar(char ch) {
   sbi_call(ch, 0, 0, 0, 0, 0, 0, 1 /* Console Putchar */);
 }
 
+// 타임 슬라이스 길이 (ms), 실행 중에도 timeslice 시스템 콜로 바꿀 수 있음
+uint32_t time_slice_ms = TIME_SLICE_MS;
+struct sched_stats sched_stats;
+
+// 64비트 time CSR 읽기 (RV32에서는 time/timeh를 나눠 읽으므로 상위 워드가
+// 바뀌지 않았는지 확인하며 반복)
+uint64_t read_time(void) {
+  uint32_t hi, lo;
+  do {
+    hi = READ_CSR(timeh);
+    lo = READ_CSR(time);
+  } while (hi != READ_CSR(timeh));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+// SBI TIME 확장으로 다음 타이머 인터럽트 시각을 설정
+// (시각을 새로 설정하면 대기 중인 타이머 인터럽트(sip.STIP)도 해제됨)
+void sbi_set_timer(uint64_t stime) {
+  sbi_call((uint32_t)stime, (uint32_t)(stime >> 32), 0, 0, 0, 0, 0,
+           0x54494D45 /* TIME */);
+}
+
+uint64_t flush_deadline; // 지연 쓰기를 디스크에 기록해야 하는 시각 (0이면 없음)
+
+// 타이머 인터럽트 시각을 설정. 지연 쓰기 마감 시각이 더 빠르면 그때 발생
+void timer_program(uint64_t stime) {
+  if (flush_deadline && flush_deadline < stime)
+    stime = flush_deadline;
+  sbi_set_timer(stime);
+}
+
+// 지금부터 타임 슬라이스 하나가 지나면 타이머 인터럽트가 발생하도록 설정
+void timer_start_slice(void) {
+  timer_program(read_time() +
+                (uint64_t)time_slice_ms * (TIMEBASE_FREQ / 1000));
+}
+
+// 타임 슬라이스 타이머를 끔 (idle 프로세스가 실행될 때)
+// 지연 쓰기 마감 시각이 남아 있으면 그때만 깨어남
+void timer_stop(void) { timer_program(~0ull); }
+
 /**
  * @brief 프로세스 간 컨텍스트 스위치 수행
  * called-saved 레지스터(ra, sp, s0-s11)만 저장/복원하여 성능 최적화
@@ -287,42 +885,79 @@ __attribute__((naked)) void switch_context(uint32_t *prev_sp,
 }
 
 /**
- * @brief 라운드 로빈 방식의 스케줄러 (순차적)
- * 프로세스들이 자발적으로 CPU를 양보
- * 우선순위나 실행 시간은 고려 x
+ * @brief 다음에 실행할 프로세스를 골라 전환
+ * 현재 프로세스는 호출 전에 실행 큐나 대기 큐에 들어가 있어야 함
+ * 실행 가능한 프로세스가 하나도 없으면 idle 프로세스로 전환
  */
-void yield(void) {
-  // 실행 가능한 프로세스 탐색
-  struct process *next = idle_proc;
-  for (int i = 0; i < PROCS_MAX; i++) {
-    struct process *proc = &procs[(current_proc->pid + i) % PROCS_MAX];
-    if (proc->state == PROC_RUNNABLE && proc->pid > 0) {
-      next = proc;
-      break;
-    }
-  }
+void schedule(void) {
+  struct process *next = runqueue_pick();
+  if (!next)
+    next = idle_proc;
 
-  // 현재 프로세스를 제외하고 실행 가능한 프로세스가 없다면 리턴
+  // 다음 프로세스에게 새 타임 슬라이스 부여
+  // idle 프로세스는 선점할 필요가 없으므로 타이머를 꺼서 wfi에서 깨지 않게 함
+  if (next == idle_proc)
+    timer_stop();
+  else
+    timer_start_slice();
+
+  // 다시 현재 프로세스가 선택되었다면 전환 없이 리턴
   if (next == current_proc)
     return;
 
+  // satp 레지스터에 다음 프로세스의 페이지 테이블과 ASID를 설정
+  switch_address_space(next);
+
   // 다음 프로세스의 스택 포인터를 sscratch CSR에 저장
   // 나중에 예외가 발생했을 때, 커널이 이 스택을 사용하여 컨텍스트 복원
   __asm__ __volatile__(
-      "sfence.vma\n" // TLB(Tanslation Lookaside Buffer) 엔트리를 모두 무효화
-      "csrw satp, %[satp]\n" // satp 레지스터에 값을 쓰면 페이지 테이블 변경
-      "sfence.vma\n" // 새로운 페이지 테이블 설정이 즉시 적용되도록 무효화 처리
       "csrw sscratch, %[sscratch]\n"
       :
-      : [satp] "r"(SATP_SV32 | ((uint32_t)next->page_table / PAGE_SIZE)),
-        [sscratch] "r"((uint32_t)&next->stack[sizeof(next->stack)]));
+      : [sscratch] "r"(next->kstack_top));
 
   // 컨텍스트 스위칭
   struct process *prev = current_proc;
   current_proc = next;
+  sched_stats.switches++;
   switch_context(&prev->sp, &next->sp);
 }
 
+/**
+ * @brief 현재 프로세스의 CPU를 양보
+ * 현재 프로세스를 같은 우선순위 실행 큐의 맨 뒤에 넣고 가장 높은 우선순위의
+ * 프로세스를 실행 (같은 우선순위끼리는 라운드 로빈)
+ */
+void yield(void) {
+  if (current_proc != idle_proc && current_proc->state == PROC_RUNNABLE)
+    runqueue_add(current_proc, current_proc->priority);
+  schedule();
+}
+
+// 현재 프로세스를 대기 큐에 넣고 잠듦, proc_wakeup으로 깨어날 때까지 실행되지 않음
+void proc_sleep(struct proc_queue *wq) {
+  current_proc->state = PROC_BLOCKED;
+  proc_queue_push(wq, current_proc);
+  schedule();
+}
+
+// 대기 큐의 모든 프로세스를 깨움
+void proc_wakeup_all(struct proc_queue *wq) {
+  struct process *proc;
+  while ((proc = proc_queue_pop(wq)))
+    proc_wakeup(proc);
+}
+
+// 스케줄러 통계 출력
+void sched_dump_stats(void) {
+  printf("sched: time_slice=%dms timer_irqs=%d switches=%d exits=%d "
+         "reaps=%d\n",
+         time_slice_ms, sched_stats.timer_irqs, sched_stats.switches,
+         sched_stats.exits, sched_stats.reaps);
+  printf("procs: live=%d peak=%d slab_pages=%d kstack_free=%d\n",
+         proc_cache.objs, sched_stats.peak_procs, proc_cache.pages,
+         kstack_free_count);
+}
+
 /**
  * @brief 예외 처리 핸들러
  * 1. 현재 실행 컨텍스트를 모두 저장
@@ -380,6 +1015,10 @@ __attribute__((naked)) __attribute__((aligned(4))) void kernel_entry(void) {
       "mv a0, sp\n"        // 현재 스택 포인터를 인자로 전달
       "call handle_trap\n" // ! 실제 예외 처리 함수 호출
 
+      // 스택의 trap_frame으로 사용자 모드에 복귀 (fork_child_entry도 사용)
+      ".global trap_return\n"
+      "trap_return:\n"
+
       "lw ra,  4 * 0(sp)\n" // 리턴 주소 복원
       "lw gp,  4 * 1(sp)\n" // 전역 포인터 복원
       "lw tp,  4 * 2(sp)\n"
@@ -414,6 +1053,16 @@ __attribute__((naked)) __attribute__((aligned(4))) void kernel_entry(void) {
       "sret\n");             // 예외 처리 완료, 원래 실행 지점으로 복귀
 }
 
+// fork로 만든 자식이 처음 실행될 때 진입하는 함수
+// 커널 스택 맨 위에 부모의 trap_frame 복사본이 있고, s0에 복귀할 주소가 있음
+__attribute__((naked)) void fork_child_entry(void) {
+  __asm__ __volatile__("csrw sepc, s0\n"
+                       "csrw sstatus, %[sstatus]\n"
+                       "j trap_return\n"
+                       :
+                       : [sstatus] "r"(SSTATUS_SPIE | SSTATUS_SUM));
+}
+
 void delay(void) {
   for (int i = 0; i < 30000000; i++)
     __asm__ __volatile__("nop"); // do nothing
@@ -438,127 +1087,2089 @@ void proc_b_entry(void) {
   }
 }
 
-// SBI 호출을 통해 문자 입력을 받음
-long getchar(void) {
-  struct sbiret ret = sbi_call(0, 0, 0, 0, 0, 0, 0, 2);
-  return ret.error;
+// PLIC 레지스터 읽기/쓰기
+uint32_t plic_read32(paddr_t addr) { return *((volatile uint32_t *)addr); }
+void plic_write32(paddr_t addr, uint32_t value) {
+  *((volatile uint32_t *)addr) = value;
 }
 
-// 파일명을 기준으로 파일을 검색
-struct file *fs_lookup(const char *filename) {
-  for (int i = 0; i < FILES_MAX; i++) {
-    struct file *file = &files[i];
-    if (!strcmp(file->name, filename))
-      return file;
-  }
+// PLIC 초기화: 사용할 인터럽트의 우선순위를 설정하고 활성화
+void plic_init(void) {
+  plic_write32(PLIC_PRIORITY(UART0_IRQ), 1);
+  plic_write32(PLIC_PRIORITY(VIRTIO_BLK_IRQ), 1);
+  plic_write32(PLIC_SENABLE, plic_read32(PLIC_SENABLE) | (1 << UART0_IRQ) |
+                                 (1 << VIRTIO_BLK_IRQ));
+  plic_write32(PLIC_STHRESHOLD, 0);
+}
 
-  return NULL;
+// UART 레지스터 읽기/쓰기
+uint8_t uart_read8(unsigned offset) {
+  return *((volatile uint8_t *)(UART0_PADDR + offset));
+}
+void uart_write8(unsigned offset, uint8_t value) {
+  *((volatile uint8_t *)(UART0_PADDR + offset)) = value;
 }
 
-// TAR 형식으로 파일 시스템을 구성하고 가상 블록 장치에 저장
-void fs_flush(void) {
+// 콘솔 입력 링 버퍼 (UART 인터럽트 핸들러가 채우고 SYS_GETCHAR가 비움)
+char console_buf[CONSOLE_BUF_SIZE];
+uint32_t console_head;             // 다음에 읽을 위치
+uint32_t console_tail;             // 다음에 쓸 위치
+struct proc_queue console_waiters; // 입력을 기다리는 프로세스들
 
-  // 모든 파일 내용을 'disk' 버퍼에 복사
-  memset(disk, 0, sizeof(disk));
+// UART 초기화: 전송 설정은 OpenSBI가 마쳤으므로 수신 인터럽트만 켬
+void uart_init(void) { uart_write8(UART_IER, UART_IER_RX); }
 
-  // 현재 디스크 오프셋 위치를 추적
-  unsigned off = 0;
+// UART 수신 인터럽트 처리: 도착한 문자를 모두 링 버퍼로 옮기고 대기자를 깨움
+void uart_intr(void) {
+  while (uart_read8(UART_LSR) & UART_LSR_DR) {
+    char ch = uart_read8(UART_RBR);
+    if (console_tail - console_head < CONSOLE_BUF_SIZE)
+      console_buf[console_tail++ % CONSOLE_BUF_SIZE] = ch;
+  }
 
-  // 모든 파일을 순회하며 TAR 형식으로 디스크에 저장
-  for (int file_i = 0; file_i < FILES_MAX; file_i++) {
-    struct file *file = &files[file_i];
-    if (!file->in_use) // 사용중이지 않으면 건너뜀
-      continue;
+  proc_wakeup_all(&console_waiters);
+}
 
-    // TAR 헤더 구성
-    struct tar_header *header = (struct tar_header *)&disk[off];
-    memset(header, 0, sizeof(*header));
-    strcpy(header->name, file->name);
-    strcpy(header->mode, "000644");
-    strcpy(header->magic, "ustar");
-    strcpy(header->version, "00");
-    header->type = '0';
+// 콘솔 입력 버퍼에서 문자 하나를 꺼냄 (비어 있으면 -1)
+long getchar(void) {
+  if (console_head == console_tail)
+    return -1;
+  return (uint8_t)console_buf[console_head++ % CONSOLE_BUF_SIZE];
+}
 
-    // 파일 크기를 8진수 문자열로 변환하여 헤더에 설정
-    int filesz = file->size;
-    for (int i = sizeof(header->size); i > 0; i--) {
-      header->size[i - 1] = (filesz % 8) + '0';
-      filesz /= 8;
+// PLIC에서 대기 중인 외부 인터럽트를 모두 처리
+void plic_handle_irq(void) {
+  uint32_t irq;
+  while ((irq = plic_read32(PLIC_SCLAIM)) != 0) {
+    switch (irq) {
+    case UART0_IRQ:
+      uart_intr();
+      break;
+    case VIRTIO_BLK_IRQ:
+      virtio_blk_intr();
+      break;
+    default:
+      printf("plic: unexpected irq %d\n", irq);
     }
 
-    // 헤더 체크섬 계산
-    int checksum = ' ' * sizeof(header->checksum);
-    for (unsigned i = 0; i < sizeof(struct tar_header); i++)
-      checksum += (unsigned char)disk[off + i];
+    // 처리 완료를 알려야 같은 인터럽트를 다시 받을 수 있음
+    plic_write32(PLIC_SCLAIM, irq);
+  }
+}
+
+short fs_index[FS_INDEX_SIZE]; // 이름 해시 -> files[] 번호
+unsigned fs_index_deleted;     // 색인에서 삭제된 칸 수
+int fs_last_used = -1;         // 사용 중인 files[] 칸 중 가장 뒤의 번호
+uint32_t fs_free_map[FILES_MAX / 32]; // 비트가 1이면 files[]의 빈 칸
+
+// 파일 이름의 해시 값 (FNV-1a)
+uint32_t fs_name_hash(const char *name) {
+  uint32_t hash = 2166136261u;
+  for (; *name; name++)
+    hash = (hash ^ (uint8_t)*name) * 16777619u;
+  return hash;
+}
+
+// 색인을 비움 (0은 files[0]을 뜻하므로 EMPTY로 채움)
+void fs_index_init(void) {
+  for (int i = 0; i < FS_INDEX_SIZE; i++)
+    fs_index[i] = FS_INDEX_EMPTY;
+  fs_index_deleted = 0;
+}
+
+// 파일 이름이 있는 색인 칸을 찾음 (없으면 -1)
+// 해시 값이 같은 경우에만 문자열을 비교
+int fs_index_find(const char *filename, uint32_t hash) {
+  for (uint32_t i = 0; i < FS_INDEX_SIZE; i++) {
+    uint32_t slot = (hash + i) & (FS_INDEX_SIZE - 1);
+    int idx = fs_index[slot];
+    if (idx == FS_INDEX_EMPTY)
+      break;
+    if (idx != FS_INDEX_DELETED && files[idx].hash == hash &&
+        !strcmp(files[idx].name, filename))
+      return slot;
+  }
+
+  return -1;
+}
 
-    // 계산된 체크섬을 8진수 문자열로 변환하여 헤더에 설정
-    for (int i = 5; i >= 0; i--) {
-      header->checksum[i] = (checksum % 8) + '0';
-      checksum /= 8;
+// 파일을 색인에 추가 (삭제된 칸이 있으면 재사용)
+void fs_index_insert(struct file *file) {
+  for (uint32_t i = 0;; i++) {
+    uint32_t slot = (file->hash + i) & (FS_INDEX_SIZE - 1);
+    if (fs_index[slot] < 0) {
+      if (fs_index[slot] == FS_INDEX_DELETED)
+        fs_index_deleted--;
+      fs_index[slot] = file - files;
+      return;
     }
+  }
+}
+
+// 삭제된 칸이 쌓이면 없는 이름을 찾을 때 탐색이 길어지므로 색인을 다시 만듦
+// 삭제 FS_INDEX_DELETED_MAX번마다 한 번이므로 삭제당 비용은 평균 O(1)
+void fs_index_rebuild(void) {
+  fs_index_init();
+  for (int i = 0; i <= fs_last_used; i++) {
+    if (files[i].in_use)
+      fs_index_insert(&files[i]);
+  }
+}
 
-    // 파일 데이터를 헤더 뒤에 복사
-    memcpy(header->data, file->data, file->size);
+// files[i]를 빈 칸/사용 중인 칸으로 표시
+void fs_slot_mark(int i, bool free) {
+  if (free)
+    fs_free_map[i / 32] |= 1u << (i % 32);
+  else
+    fs_free_map[i / 32] &= ~(1u << (i % 32));
+}
 
-    // 다음 파일을 위해 오프셋 업데이트 (섹터 크기에 맞게 정렬)
-    off += align_up(sizeof(struct tar_header) + file->size, SECTOR_SIZE);
+// 가장 앞의 빈 칸 번호 (없으면 -1), 비트맵을 워드 단위로 확인
+int fs_first_free_slot(void) {
+  for (int w = 0; w < FILES_MAX / 32; w++) {
+    if (fs_free_map[w])
+      return w * 32 + __builtin_ctz(fs_free_map[w]);
   }
+  return -1;
+}
+
+// 파일명을 기준으로 파일을 검색 (해시 색인, 평균 O(1))
+struct file *fs_lookup(const char *filename) {
+  int slot = fs_index_find(filename, fs_name_hash(filename));
+  return slot < 0 ? NULL : &files[fs_index[slot]];
+}
 
-  // disk 버퍼의 내용을 virtio-blk 디바이스에 기록
-  for (unsigned sector = 0; sector < sizeof(disk) / SECTOR_SIZE; sector++)
-    read_write_disk(&disk[sector * SECTOR_SIZE], sector, true);
+unsigned fs_end_sector;  // 디스크에서 아카이브가 끝나는 섹터 번호
+unsigned fs_used_sectors; // 메모리의 파일 크기 기준으로 아카이브가 차지할 섹터 수
+struct fs_stats fs_stats;
 
-  printf("wrote %d bytes to disk\n", sizeof(disk));
+// 크기가 size인 파일이 아카이브에서 차지하는 섹터 수 (헤더 포함)
+unsigned fs_file_sectors(size_t size) {
+  return align_up(sizeof(struct tar_header) + size, SECTOR_SIZE) / SECTOR_SIZE;
 }
 
-// 시스템 콜의 종류를 판별하여 처리
-void handle_syscall(struct trap_frame *f) {
-  // 시스템 콜 번호가 담긴 a3 레지스터 확인
-  // ref: user.c, syscall 함수
-  switch (f->a3) {
-  case SYS_EXIT:
-    printf("process %d exited\n", current_proc->pid);
-    current_proc->state = PROC_EXITED;
-    yield();
-    PANIC("unreachable");
-  case SYS_GETCHAR:
-    while (1) {
-      long ch = getchar();
-      if (ch >= 0) {
-        f->a0 = ch;
-        break;
-      }
+struct proc_queue fs_load_waiters; // 페이지 캐시 잠금을 기다리는 큐
+struct proc_queue fs_flush_file_waiters; // fs_flush가 파일을 다 옮기길 기다리는 큐
+bool fs_loading; // 페이지 캐시를 디스크에서 채우거나 페이지를 반환하는 중인지
 
-      // 논블로킹 I/O, CPU 양보
-      yield();
-    }
-    break;
+// 페이지 캐시 잠금. 같은 섹터를 두 번 읽어 그사이 쓰인 내용을 덮어쓰거나,
+// DMA가 진행 중인 페이지를 반환하지 않도록 채우기/반환을 직렬화
+void fs_load_lock(void) {
+  while (fs_loading)
+    proc_sleep(&fs_load_waiters);
+  fs_loading = true;
+}
 
-  case SYS_PUTCHAR:
+void fs_load_unlock(void) {
+  fs_loading = false;
+  proc_wakeup_all(&fs_load_waiters);
+}
+
+// 파일의 idx번째 페이지 엔트리의 주소. 그 범위의 색인 페이지가 없으면 alloc일
+// 때만 새로 할당하고 아니면 NULL. 색인 페이지는 파일을 삭제할 때만 반환
+paddr_t *fs_page_entry(struct file *file, uint32_t idx, bool alloc) {
+  if (idx >= FILE_PAGES_MAX)
+    PANIC("fs: page index out of range (%s, %d)", file->name, idx);
+
+  uint32_t dir = idx / FILE_INDEX_ENTRIES;
+  if (!file->pages || !file->pages[dir]) {
+    if (!alloc)
+      return NULL;
+    if (!file->pages)
+      file->pages = (paddr_t *)alloc_pages(1);
+    file->pages[dir] = alloc_pages(1);
+  }
+
+  return &((paddr_t *)file->pages[dir])[idx % FILE_INDEX_ENTRIES];
+}
+
+// 파일의 페이지 색인(색인 페이지들과 디렉터리)을 반환
+void fs_free_index(struct file *file) {
+  if (!file->pages)
+    return;
+  for (uint32_t dir = 0; dir < FILE_DIR_ENTRIES; dir++) {
+    if (file->pages[dir])
+      free_pages(file->pages[dir], 1);
+  }
+  free_pages((paddr_t)file->pages, 1);
+  file->pages = NULL;
+}
+
+// fs_flush가 파일의 idx번째 페이지를 이미 새 위치에 기록했는지 여부
+bool fs_page_flushed(struct file *file, uint32_t idx) {
+  uint32_t off = idx * PAGE_SIZE;
+  return file->flushing && off >= file->flushed_lo && off < file->flushed_hi;
+}
+
+// idx번째 페이지의 s번째 섹터를 읽어 올 디스크 섹터 (fs_flush가 이미 새
+// 위치에 기록한 페이지는 새 위치에서 읽음)
+unsigned fs_page_sector(struct file *file, uint32_t idx, uint32_t s) {
+  unsigned base =
+      fs_page_flushed(file, idx) ? file->flush_sector : file->sector;
+  return base + 1 + idx * FILE_PAGE_SECTORS + s;
+}
+
+// idx번째 페이지를 읽어 올 위치에서 데이터가 끝나는 곳 (그 뒤는 0)
+uint32_t fs_page_disk_end(struct file *file, uint32_t idx) {
+  return fs_page_flushed(file, idx) ? file->flushed_hi : file->disk_size;
+}
+
+struct page fs_lru = {.next = &fs_lru, .prev = &fs_lru}; // 앞쪽이 오래된 페이지
+uint32_t fs_cache_pages; // 페이지 캐시가 가진 페이지 수
+
+// 페이지 캐시 페이지를 LRU 목록의 끝에 추가/목록에서 삭제
+void fs_lru_push(struct page *pg) {
+  pg->prev = fs_lru.prev;
+  pg->next = &fs_lru;
+  fs_lru.prev->next = pg;
+  fs_lru.prev = pg;
+}
+
+void fs_lru_remove(struct page *pg) {
+  pg->prev->next = pg->next;
+  pg->next->prev = pg->prev;
+  pg->next = pg->prev = NULL;
+}
+
+// 파일의 idx번째 페이지 엔트리를 돌려줌, 페이지가 없으면 새로 할당
+// 디스크에 내용이 없는 섹터(disk_size 이후)는 처음부터 유효 (0으로 채워짐)
+paddr_t fs_alloc_page(struct file *file, uint32_t idx) {
+  paddr_t *entry = fs_page_entry(file, idx, true);
+  if (!*entry) {
+    uint32_t valid = 0;
+    for (uint32_t s = 0; s < FILE_PAGE_SECTORS; s++) {
+      if (idx * PAGE_SIZE + s * SECTOR_SIZE >= fs_page_disk_end(file, idx))
+        valid |= 1 << s;
+    }
+
+    paddr_t paddr = alloc_pages(1);
+    struct page *pg = paddr_to_page(paddr);
+    pg->file = file;
+    pg->idx = idx;
+    fs_lru_push(pg);
+    fs_cache_pages++;
+    *entry = paddr | valid;
+  }
+
+  return *entry;
+}
+
+// 페이지 캐시 페이지를 반환하고 엔트리를 비움
+void fs_release_page(paddr_t *entry) {
+  struct page *pg = paddr_to_page(FILE_PAGE_ADDR(*entry));
+  fs_lru_remove(pg);
+  fs_cache_pages--;
+  pg->file = NULL;
+  pg->flags = 0;
+  free_pages(FILE_PAGE_ADDR(*entry), 1);
+  *entry = 0;
+}
+
+/**
+ * @brief 깨끗한 페이지 캐시 페이지를 최대 n개 회수 (clock 방식)
+ * LRU 목록의 앞(오래된 쪽)부터 보면서 최근에 사용된 페이지는 표시만 지우고
+ * 뒤로 보냄. 바뀐(dirty) 페이지, 선읽기나 기록 중인 페이지, mmap으로 매핑된
+ * 파일의 페이지는 건너뜀. 회수한 페이지는 다음 접근 때 디스크에서 다시 읽음
+ * 잠들지 않으므로 페이지 할당자 안에서 호출해도 됨
+ *
+ * @param n 회수할 페이지 수
+ * @return uint32_t 회수한 페이지 수 (0이면 회수할 수 있는 페이지가 없음)
+ */
+uint32_t fs_reclaim(uint32_t n) {
+  uint32_t freed = 0;
+  uint32_t limit = 2 * fs_cache_pages; // 표시를 지운 페이지를 한 번 더 볼 수 있음
+  for (uint32_t scanned = 0; freed < n && scanned < limit; scanned++) {
+    struct page *pg = fs_lru.next;
+    if (pg == &fs_lru)
+      break;
+
+    paddr_t *entry = fs_page_entry(pg->file, pg->idx, false);
+    bool busy = (pg->flags & PG_LOCKED) ||
+                (*entry & (FILE_PAGE_RA | FILE_PAGE_DIRTY)) ||
+                pg->file->map_count > 0;
+    if (busy || (pg->flags & PG_REFERENCED)) {
+      pg->flags &= ~PG_REFERENCED;
+      fs_lru_remove(pg);
+      fs_lru_push(pg);
+      continue;
+    }
+
+    fs_release_page(entry);
+    fs_stats.evictions++;
+    freed++;
+  }
+  return freed;
+}
+
+// 페이지의 end번째 섹터 앞까지 읽었을 때, 디스크의 데이터 끝을 넘는 부분을
+// 0으로 채움
+void fs_zero_past_disk(struct file *file, uint32_t idx, uint8_t *page,
+                       uint32_t end) {
+  uint32_t disk_end = fs_page_disk_end(file, idx);
+  uint32_t end_off = idx * PAGE_SIZE + end * SECTOR_SIZE;
+  if (end_off > disk_end && disk_end >= idx * PAGE_SIZE)
+    memset(page + (disk_end - idx * PAGE_SIZE), 0, end_off - disk_end);
+}
+
+/**
+ * @brief 파일의 idx번째 페이지에서 [off, off + len) 범위를 사용할 수 있게 함
+ * 페이지가 없으면 새로 할당하고, 범위에 걸친 섹터 중 아직 읽지 않은 것만
+ * 블록 계층을 통해 페이지로 바로 읽어 옴. overwrite이면 범위가 통째로 덮는
+ * 섹터는 읽지 않고 유효로 표시 (호출한 쪽이 잠들지 않고 바로 덮어써야 함)
+ *
+ * @param file 파일
+ * @param idx 파일 내 페이지 번호
+ * @param off 페이지 내 시작 위치
+ * @param len 범위의 길이
+ * @param overwrite 범위를 곧바로 덮어쓸지 여부
+ * @return uint8_t* 페이지의 주소 (커널 영역은 일대일 매핑)
+ */
+uint8_t *fs_get_page(struct file *file, uint32_t idx, uint32_t off,
+                     uint32_t len, bool overwrite) {
+  uint32_t first = off / SECTOR_SIZE;
+  uint32_t last = (off + len - 1) / SECTOR_SIZE;
+  uint32_t range = ((1u << (last + 1)) - 1) & ~((1u << first) - 1);
+  uint32_t want = range;
+  if (overwrite) {
+    // 앞뒤로 일부만 덮는 섹터만 읽으면 됨
+    for (uint32_t s = first; s <= last; s++) {
+      if (s * SECTOR_SIZE >= off && (s + 1) * SECTOR_SIZE <= off + len)
+        want &= ~(1u << s);
+    }
+  }
+
+  paddr_t *slot = fs_page_entry(file, idx, true);
+  for (;;) {
+    paddr_t entry = fs_alloc_page(file, idx);
+
+    // 선읽기가 진행 중이면 끝날 때까지 기다림 (덮어쓸 섹터에 선읽기 데이터가
+    // 나중에 들어오면 안 됨)
+    bool ready = (entry & want) == want;
+    if (entry & FILE_PAGE_RA && (!ready || overwrite)) {
+      blk_wait();
+      continue;
+    }
+
+    // 다른 프로세스가 잠금을 잡고 섹터를 읽는 중이면 끝날 때까지 기다림
+    // (덮어쓴 섹터에 읽기 DMA가 나중에 완료되면 이전 내용으로 되돌아감)
+    if (ready && overwrite && fs_loading) {
+      fs_load_lock();
+      fs_load_unlock();
+      continue;
+    }
+    if (ready)
+      break;
+
+    // 잠금을 기다리는 동안 다른 프로세스가 채웠거나 페이지가 반환되었을 수
+    // 있으므로 처음부터 다시 확인
+    fs_load_lock();
+    entry = *slot;
+    if (!entry || (entry & FILE_PAGE_RA) || (entry & want) == want) {
+      fs_load_unlock();
+      continue;
+    }
+
+    // 읽는 동안 잠들어도 페이지가 회수되지 않도록 표시
+    uint8_t *page = (uint8_t *)FILE_PAGE_ADDR(entry);
+    struct page *pg = paddr_to_page((paddr_t)page);
+    pg->flags |= PG_LOCKED;
+    for (uint32_t s = 0; s < FILE_PAGE_SECTORS;) {
+      if (!(want & (1 << s)) || (entry & (1 << s))) {
+        s++;
+        continue;
+      }
+
+      // 연속해서 비어 있는 섹터들을 요청 하나로 읽음
+      uint32_t n = 1;
+      while (s + n < FILE_PAGE_SECTORS && (want & (1 << (s + n))) &&
+             !(entry & (1 << (s + n))))
+        n++;
+      read_write_disk_batch(page + s * SECTOR_SIZE,
+                            fs_page_sector(file, idx, s), n, false);
+      fs_zero_past_disk(file, idx, page, s + n);
+
+      for (uint32_t i = s; i < s + n; i++)
+        entry |= 1 << i;
+      fs_stats.sector_loads += n;
+      s += n;
+    }
+
+    *slot |= entry & FILE_PAGE_VALID_ALL;
+    pg->flags &= ~PG_LOCKED;
+    fs_load_unlock();
+    break;
+  }
+
+  // 덮어쓸 섹터까지 모두 유효로 표시하고, 덮어쓰면 다음 기록의 대상
+  *slot |= range;
+  if (overwrite)
+    *slot |= FILE_PAGE_DIRTY;
+  paddr_to_page(FILE_PAGE_ADDR(*slot))->flags |= PG_REFERENCED;
+  return (uint8_t *)FILE_PAGE_ADDR(*slot);
+}
+
+// 진행 중인 선읽기 요청 (file이 NULL이면 빈 칸)
+struct fs_ra {
+  struct file *file;  // 선읽기 대상 파일
+  uint32_t idx;       // 파일 내 페이지 번호
+  paddr_t *slot;      // 페이지 색인의 엔트리
+  uint32_t first, n;  // 페이지 안에서 읽는 섹터 범위
+} fs_ra_slots[FS_RA_SLOTS];
+
+// 선읽기 요청 완료 콜백. used ring을 회수할 때 호출되므로 잠들지 않음
+void fs_ra_done(struct blk_request *r) {
+  struct fs_ra *ra = r->ctx;
+  struct file *file = ra->file;
+  paddr_t entry = *ra->slot;
+  if (blk_complete(r)) {
+    fs_zero_past_disk(file, ra->idx, (uint8_t *)FILE_PAGE_ADDR(entry),
+                      ra->first + ra->n);
+    for (uint32_t i = ra->first; i < ra->first + ra->n; i++)
+      entry |= 1 << i;
+  }
+
+  *ra->slot = entry & ~FILE_PAGE_RA;
+  ra->file = NULL;
+}
+
+/**
+ * @brief 순차 읽기를 감지해 다음 섹터들을 미리 읽기 시작 (readahead)
+ * 직전 읽기가 끝난 위치에서 이어 읽으면 선읽기 창을 두 배씩 키우고, 다른
+ * 위치를 읽으면 창을 닫음. 창 안에서 아직 읽지 않은 섹터들을 완료를 기다리지
+ * 않는 요청으로 페이지 캐시에 읽어 둠
+ *
+ * @param file 파일
+ * @param off 이번 읽기의 시작 위치
+ * @param len 이번 읽기의 길이
+ */
+void fs_readahead(struct file *file, uint32_t off, uint32_t len) {
+  if (off != file->ra_next)
+    file->ra_window = 0;
+  else if (file->ra_window == 0)
+    file->ra_window = FS_RA_MIN_SECTORS;
+  else if (file->ra_window < FS_RA_MAX_SECTORS)
+    file->ra_window *= 2;
+  file->ra_next = off + len;
+
+  // 잠금을 잡은 쪽이 디스크를 읽거나 쓰는 중이면 선읽기를 미룸 (fs_flush가
+  // 옮기는 중인 파일의 기존 위치를 덮어쓰는 중일 수 있음)
+  if (fs_loading)
+    return;
+
+  uint32_t sector = (off + len) / SECTOR_SIZE;
+  uint32_t end = sector + file->ra_window;
+  uint32_t disk_sectors = align_up(file->disk_size, SECTOR_SIZE) / SECTOR_SIZE;
+  if (end > disk_sectors)
+    end = disk_sectors;
+
+  // 페이지마다 비어 있는 섹터 구간 하나씩을 요청으로 제출
+  while (sector < end) {
+    uint32_t idx = sector / FILE_PAGE_SECTORS;
+    uint32_t page_end = (idx + 1) * FILE_PAGE_SECTORS;
+    if (page_end > end)
+      page_end = end;
+
+    paddr_t entry = fs_alloc_page(file, idx);
+    uint32_t first = sector % FILE_PAGE_SECTORS;
+    while (first < page_end - idx * FILE_PAGE_SECTORS && (entry & (1 << first)))
+      first++;
+    uint32_t n = 0;
+    while (first + n < page_end - idx * FILE_PAGE_SECTORS &&
+           !(entry & (1 << (first + n))))
+      n++;
+    sector = page_end;
+    if (n == 0 || (entry & FILE_PAGE_RA))
+      continue;
+
+    struct fs_ra *ra = NULL;
+    for (int i = 0; i < FS_RA_SLOTS && !ra; i++) {
+      if (!fs_ra_slots[i].file)
+        ra = &fs_ra_slots[i];
+    }
+    if (!ra)
+      break;
+
+    paddr_t *slot = fs_page_entry(file, idx, false);
+    *ra = (struct fs_ra){
+        .file = file, .idx = idx, .slot = slot, .first = first, .n = n};
+    *slot |= FILE_PAGE_RA;
+    if (!blk_read_async((uint8_t *)FILE_PAGE_ADDR(entry) + first * SECTOR_SIZE,
+                        fs_page_sector(file, idx, first), n, fs_ra_done, ra)) {
+      // 디스크립터가 모자라거나 용량을 벗어나면 선읽기를 멈춤
+      // (요청한 읽기를 방해하지 않음)
+      *slot &= ~FILE_PAGE_RA;
+      ra->file = NULL;
+      break;
+    }
+    fs_stats.ra_sectors += n;
+  }
+}
+
+// 파일 크기를 바꾸고, 아카이브가 차지할 섹터 수를 갱신
+void fs_set_size(struct file *file, size_t size) {
+  fs_used_sectors += fs_file_sectors(size) - fs_file_sectors(file->size);
+  file->size = size;
+}
+
+// 파일을 size 바이트로 자름. 범위를 벗어난 페이지는 반환하고, 마지막 페이지의
+// 나머지는 0으로 채워서 나중에 파일이 커져도 이전 내용이 보이지 않게 함
+void fs_truncate(struct file *file, size_t size) {
+  // fs_flush가 새 위치로 옮기는 중인 파일은 다 옮긴 뒤에 자름 (옮긴 범위의
+  // 내용이 바뀌면 디스크의 어느 위치를 믿어야 할지 알 수 없음)
+  fs_load_lock();
+  while (file->flushing) {
+    fs_load_unlock();
+    proc_sleep(&fs_flush_file_waiters);
+    fs_load_lock();
+  }
+
+  if (file->pages) {
+    for (uint32_t idx = align_up(size, PAGE_SIZE) / PAGE_SIZE;
+         idx < FILE_PAGES_MAX; idx++) {
+      paddr_t *entry = fs_page_entry(file, idx, false);
+      if (!entry) {
+        // 색인 페이지가 없는 범위는 통째로 건너뜀
+        idx = align_up(idx + 1, FILE_INDEX_ENTRIES) - 1;
+        continue;
+      }
+
+      // 선읽기 DMA가 진행 중인 페이지는 끝난 뒤에 반환
+      while (*entry & FILE_PAGE_RA)
+        blk_wait();
+      if (!*entry)
+        continue;
+
+      // mmap으로 매핑된 페이지는 사용자 페이지 테이블이 가리키고 있으므로
+      // 반환하지 않고 0으로 채워서 유지
+      if (file->map_count > 0) {
+        memset((uint8_t *)FILE_PAGE_ADDR(*entry), 0, PAGE_SIZE);
+        *entry |= FILE_PAGE_VALID_ALL;
+      } else {
+        fs_release_page(entry);
+      }
+    }
+
+    paddr_t *entry =
+        size % PAGE_SIZE ? fs_page_entry(file, size / PAGE_SIZE, false) : NULL;
+    if (entry) {
+      while (*entry & FILE_PAGE_RA)
+        blk_wait();
+      if (*entry) {
+        memset((uint8_t *)FILE_PAGE_ADDR(*entry) + size % PAGE_SIZE, 0,
+               PAGE_SIZE - size % PAGE_SIZE);
+        *entry |= FILE_PAGE_DIRTY;
+      }
+    }
+  }
+
+  // 잘린 뒤의 섹터는 디스크에서 읽지 않음 (남은 페이지에서는 0으로 유효)
+  if (file->disk_size > size) {
+    file->disk_size = size;
+    paddr_t *entry =
+        size % PAGE_SIZE ? fs_page_entry(file, size / PAGE_SIZE, false) : NULL;
+    if (entry && *entry) {
+      uint32_t first = align_up(size % PAGE_SIZE, SECTOR_SIZE) / SECTOR_SIZE;
+      *entry |= FILE_PAGE_VALID_ALL & ~((1u << first) - 1);
+    }
+  }
+  fs_set_size(file, size);
+  fs_load_unlock();
+}
+
+// 파일의 off 위치부터 최대 len 바이트를 buf로 읽음, 읽은 바이트 수를 리턴
+// 범위에 걸친 섹터만 디스크에서 읽음
+int fs_read(struct file *file, uint32_t off, void *buf, uint32_t len) {
+  if (off >= file->size)
+    return 0;
+  if (len > file->size - off)
+    len = file->size - off;
+
+  for (uint32_t done = 0; done < len;) {
+    uint32_t poff = (off + done) % PAGE_SIZE;
+    uint32_t n = PAGE_SIZE - poff < len - done ? PAGE_SIZE - poff : len - done;
+    uint8_t *page = fs_get_page(file, (off + done) / PAGE_SIZE, poff, n, false);
+    memcpy((uint8_t *)buf + done, page + poff, n);
+    done += n;
+  }
+
+  fs_readahead(file, off, len);
+  return len;
+}
+
+// buf의 len 바이트를 파일의 off 위치에 씀, 필요하면 파일 크기를 늘림
+// 최대 파일 크기나 디스크 용량을 넘으면 -1을 리턴
+int fs_write(struct file *file, uint32_t off, const void *buf, uint32_t len) {
+  uint32_t end = off + len;
+  if (end < off || end > FILE_SIZE_MAX)
+    return -1;
+
+  // 아카이브의 끝을 나타내는 빈 헤더 자리까지 남겨 둠
+  if (end > file->size &&
+      fs_used_sectors + fs_file_sectors(end) - fs_file_sectors(file->size) + 1 >
+          blk_capacity / SECTOR_SIZE)
+    return -1;
+
+  for (uint32_t done = 0; done < len;) {
+    uint32_t poff = (off + done) % PAGE_SIZE;
+    uint32_t n = PAGE_SIZE - poff < len - done ? PAGE_SIZE - poff : len - done;
+    uint8_t *page = fs_get_page(file, (off + done) / PAGE_SIZE, poff, n, true);
+    memcpy(page + poff, (const uint8_t *)buf + done, n);
+    done += n;
+  }
+
+  if (end > file->size)
+    fs_set_size(file, end);
+  return len;
+}
+
+// 파일의 TAR 헤더를 섹터 크기의 버퍼에 구성
+void fs_encode_header(const char *name, size_t size, uint8_t *sector_buf) {
+  struct tar_header *header = (struct tar_header *)sector_buf;
+  memset(header, 0, sizeof(*header));
+  strcpy(header->name, name);
+  strcpy(header->mode, "000644");
+  strcpy(header->magic, "ustar");
+  strcpy(header->version, "00");
+  header->type = '0';
+
+  // 파일 크기를 8진수 문자열로 변환하여 헤더에 설정
+  for (int i = sizeof(header->size); i > 0; i--) {
+    header->size[i - 1] = (size % 8) + '0';
+    size /= 8;
+  }
+
+  // 헤더 체크섬 계산
+  int checksum = ' ' * sizeof(header->checksum);
+  for (unsigned i = 0; i < sizeof(struct tar_header); i++)
+    checksum += (unsigned char)sector_buf[i];
+
+  // 계산된 체크섬을 8진수 문자열로 변환하여 헤더에 설정
+  for (int i = 5; i >= 0; i--) {
+    header->checksum[i] = (checksum % 8) + '0';
+    checksum /= 8;
+  }
+}
+
+// 헤더 섹터 내용을 버퍼 캐시에 씀. 캐시된 내용과 같으면 dirty로 표시하지 않음
+// 디스크에 기록할 섹터가 생겼으면 true를 리턴 (파일 데이터는 fs_flush_data)
+bool fs_write_sector(unsigned sector, const uint8_t *data) {
+  struct buf *b = bget(sector);
+  bool changed = !b->valid || memcmp(b->data, data, SECTOR_SIZE) != 0;
+  if (changed) {
+    memcpy(b->data, data, SECTOR_SIZE);
+    bdirty(b);
+  }
+  brelse(b);
+  return changed;
+}
+
+// fs_flush가 배치를 확정할 때 기록해 두는 칸별 상태
+// 기록하는 동안 잠든 사이 파일이 삭제/생성되어도 확정한 배치대로 씀
+struct fs_flush_slot {
+  bool in_use;            // 배치를 확정할 때 사용 중이었는지 여부
+  bool rewrite;           // 이번 기록에서 다시 구성할 파일인지 여부
+  unsigned sector;        // 헤더를 쓸 섹터
+  unsigned old_sector;    // 배치를 확정할 때 디스크에 있던 헤더의 섹터
+  size_t size;            // 다시 구성할 때 사용할 파일 크기
+  char name[100];         // 헤더에 쓸 파일 이름
+} fs_flush_slots[FILES_MAX];
+
+int fs_flush_order[FILES_MAX]; // 다시 구성할 파일들을 옮기는 순서
+
+// fs_flush가 잠금을 한 번 잡고 기록하는 구간 (파일 하나의 [first, end) 페이지)
+struct fs_flush_window {
+  int file_i;
+  uint32_t first, end;
+  bool last; // 파일의 마지막 구간이면 기록이 끝난 뒤 헤더를 씀
+};
+
+// 뒤쪽(더 큰 섹터)으로 밀려나는 파일인지 여부
+bool fs_flush_up(struct fs_flush_slot *slot) {
+  return slot->old_sector != BCACHE_NO_SECTOR &&
+         slot->sector > slot->old_sector;
+}
+
+// fs_flush가 페이지 캐시와 디스크 사이에 주고받는 요청들
+// 디스크에서 이어지는 섹터들을 scatter-gather 요청 하나로 모으고, 요청들은
+// 완료를 기다리지 않고 이어서 제출 (파이프라이닝)
+struct fs_io {
+  struct blk_request *inflight[VIRTQ_ENTRY_NUM];
+  unsigned head, tail;               // inflight 배열의 요청 단위 위치
+  unsigned sector;                   // 모으는 중인 요청의 시작 섹터
+  unsigned count;                    // 모으는 중인 요청의 섹터 수
+  struct blk_seg segs[BLK_SEGS_MAX]; // 모으는 중인 요청의 버퍼 조각
+  int nsegs;
+  int is_write;
+};
+
+// 모아 둔 요청을 제출. 진행 중인 요청이 있으면 디스크립터를 기다리며 잠들지
+// 않고 가장 오래된 요청부터 완료 (자신이 잡고 있는 디스크립터를 기다리지 않음)
+void fs_io_submit(struct fs_io *io) {
+  if (io->count == 0)
+    return;
+
+  unsigned ndescs = io->nsegs + blk_descs_needed(io->count * SECTOR_SIZE);
+  while (io->head != io->tail && !blk_can_submit(ndescs))
+    blk_complete(io->inflight[io->head++ % VIRTQ_ENTRY_NUM]);
+  io->inflight[io->tail++ % VIRTQ_ENTRY_NUM] =
+      blk_submit_sg(io->sector, io->segs, io->nsegs, io->is_write);
+  io->count = 0;
+  io->nsegs = 0;
+}
+
+// 섹터 하나를 요청에 추가. 디스크에서 이어지지 않거나 요청이 가득 차면 모아 둔
+// 요청을 먼저 제출하며, 메모리에서 이어지는 버퍼는 조각 하나로 합침
+void fs_io_add(struct fs_io *io, unsigned sector, uint8_t *buf, int is_write) {
+  if (io->count > 0 &&
+      (is_write != io->is_write || sector != io->sector + io->count ||
+       io->count == blk_max_sectors || io->nsegs == BLK_SEGS_MAX))
+    fs_io_submit(io);
+
+  if (io->count == 0) {
+    io->sector = sector;
+    io->is_write = is_write;
+  }
+  struct blk_seg *last = io->nsegs > 0 ? &io->segs[io->nsegs - 1] : NULL;
+  if (last && (uint8_t *)last->buf + last->len == buf)
+    last->len += SECTOR_SIZE;
+  else
+    io->segs[io->nsegs++] = (struct blk_seg){.buf = buf, .len = SECTOR_SIZE};
+  io->count++;
+}
+
+// 모아 둔 요청을 제출하고 진행 중인 요청이 모두 끝날 때까지 대기
+void fs_io_finish(struct fs_io *io) {
+  fs_io_submit(io);
+  while (io->head != io->tail)
+    blk_complete(io->inflight[io->head++ % VIRTQ_ENTRY_NUM]);
+}
+
+uint8_t fs_zero_sector[SECTOR_SIZE]; // 캐시된 내용이 없는 섹터에 쓰는 0
+
+/**
+ * @brief 파일의 [first, end) 페이지를 새 위치에 기록 (잠금을 잡고 호출)
+ * 위치가 바뀐 파일은 캐시에 없는 섹터를 기존 위치에서 먼저 읽어 온 뒤 모든
+ * 섹터를 쓰고, 그대로인 파일은 바뀐(dirty) 페이지의 섹터와 디스크에 없던
+ * (disk_size 이후) 섹터만 씀. 데이터는 버퍼 캐시를 거치지 않고 페이지에서
+ * 디스크로 바로 기록하며, 기록이 끝날 때까지(fs_flush_commit) 구간의
+ * 페이지는 회수하지 않음
+ *
+ * @param file 파일
+ * @param slot 배치를 확정할 때 기록해 둔 파일의 상태
+ * @param first 구간의 첫 페이지 번호
+ * @param end 구간의 끝 페이지 번호
+ * @param io 요청을 모을 곳
+ * @return unsigned 기록할 섹터 수
+ */
+unsigned fs_flush_window(struct file *file, struct fs_flush_slot *slot,
+                         uint32_t first, uint32_t end, struct fs_io *io) {
+  bool moved = slot->old_sector != slot->sector;
+
+  // 선읽기가 끝나기를 기다리고, 옮길 파일은 디스크에만 있는 섹터를 담을
+  // 페이지를 할당
+  for (uint32_t idx = first; idx < end; idx++) {
+    paddr_t *entry;
+    while ((entry = fs_page_entry(file, idx, false)) &&
+           (*entry & FILE_PAGE_RA))
+      blk_wait();
+    if (moved && idx * PAGE_SIZE < fs_page_disk_end(file, idx))
+      fs_alloc_page(file, idx);
+
+    entry = fs_page_entry(file, idx, false);
+    if (entry && *entry)
+      paddr_to_page(FILE_PAGE_ADDR(*entry))->flags |= PG_LOCKED;
+  }
+
+  // 캐시에 없는 섹터를 기존 위치에서 읽음 (새 위치에 쓰면 덮어써질 수 있음)
+  if (moved) {
+    unsigned loads = 0;
+    for (uint32_t idx = first; idx < end; idx++) {
+      paddr_t *entry = fs_page_entry(file, idx, false);
+      if (!entry || !*entry)
+        continue;
+      uint8_t *page = (uint8_t *)FILE_PAGE_ADDR(*entry);
+      for (uint32_t s = 0; s < FILE_PAGE_SECTORS; s++) {
+        if (!(*entry & (1u << s))) {
+          fs_io_add(io, fs_page_sector(file, idx, s), page + s * SECTOR_SIZE,
+                    false);
+          loads++;
+        }
+      }
+    }
+
+    // 읽은 섹터 중 마지막 섹터에서 디스크의 데이터 끝을 넘는 부분만 0으로
+    // 채움 (그 뒤의 섹터는 처음부터 유효했으므로 건드리지 않음)
+    if (loads > 0) {
+      fs_io_finish(io);
+      for (uint32_t idx = first; idx < end; idx++) {
+        paddr_t *entry = fs_page_entry(file, idx, false);
+        if (!entry || !*entry ||
+            (*entry & FILE_PAGE_VALID_ALL) == FILE_PAGE_VALID_ALL)
+          continue;
+        uint32_t last = FILE_PAGE_SECTORS;
+        while (*entry & (1u << (last - 1)))
+          last--;
+        fs_zero_past_disk(file, idx, (uint8_t *)FILE_PAGE_ADDR(*entry), last);
+        *entry |= FILE_PAGE_VALID_ALL;
+      }
+      fs_stats.sector_loads += loads;
+    }
+  }
+
+  unsigned written = 0;
+  for (uint32_t idx = first; idx < end; idx++) {
+    paddr_t *entry = fs_page_entry(file, idx, false);
+    paddr_t e = entry ? *entry : 0;
+    if (entry)
+      *entry &= ~FILE_PAGE_DIRTY; // 기록한 뒤에 바뀌면 다시 설정됨
+
+    uint8_t *page = (uint8_t *)FILE_PAGE_ADDR(e);
+    for (uint32_t s = 0; s < FILE_PAGE_SECTORS; s++) {
+      uint32_t off = idx * PAGE_SIZE + s * SECTOR_SIZE;
+      if (off >= slot->size)
+        break;
+
+      bool cached = (e & (1u << s)) != 0;
+      if (!moved && off < file->disk_size && !(cached && (e & FILE_PAGE_DIRTY)))
+        continue;
+
+      // 버퍼 캐시에 남은 이전 내용(예전 헤더 등)은 버림
+      unsigned sector = slot->sector + 1 + off / SECTOR_SIZE;
+      binval(sector);
+      fs_io_add(io, sector, cached ? page + s * SECTOR_SIZE : fs_zero_sector,
+                true);
+      written++;
+    }
+  }
+  return written;
+}
+
+/**
+ * @brief 모아 둔 구간들의 기록이 끝나기를 기다린 뒤 결과를 반영
+ * 기록한 범위는 이제 새 위치에서 읽도록 하고, 다 옮긴 파일은 위치를 바꾼 뒤
+ * 버퍼 캐시에 헤더를 씀 (데이터보다 헤더가 먼저 디스크에 닿지 않음)
+ *
+ * @return unsigned 디스크에 기록할 헤더 섹터 수
+ */
+unsigned fs_flush_commit(struct fs_flush_window *wins, int nwins,
+                         struct fs_io *io) {
+  uint8_t sector_buf[SECTOR_SIZE];
+  unsigned written = 0;
+  fs_io_finish(io);
+  for (int i = 0; i < nwins; i++) {
+    struct fs_flush_window *w = &wins[i];
+    struct file *file = &files[w->file_i];
+    struct fs_flush_slot *slot = &fs_flush_slots[w->file_i];
+    for (uint32_t idx = w->first; idx < w->end; idx++) {
+      paddr_t *entry = fs_page_entry(file, idx, false);
+      if (entry && *entry)
+        paddr_to_page(FILE_PAGE_ADDR(*entry))->flags &= ~PG_LOCKED;
+    }
+
+    if (fs_flush_up(slot))
+      file->flushed_lo = w->first * PAGE_SIZE;
+    else
+      file->flushed_hi =
+          w->end * PAGE_SIZE < slot->size ? w->end * PAGE_SIZE : slot->size;
+    if (!w->last)
+      continue;
+
+    file->sector = slot->sector;
+    file->disk_size = slot->size < file->size ? slot->size : file->size;
+    file->flushing = false;
+
+    // TAR 헤더 구성 (헤더는 섹터 하나를 정확히 채움)
+    fs_encode_header(slot->name, slot->size, sector_buf);
+    written += fs_write_sector(slot->sector, sector_buf);
+  }
+
+  proc_wakeup_all(&fs_flush_file_waiters);
+  return written;
+}
+
+/**
+ * @brief 바뀐 파일만 TAR 형식으로 다시 구성하여 가상 블록 장치에 저장
+ * 내용이 바뀌었거나(dirty), 앞 파일의 크기가 바뀌어 위치가 밀린 파일의
+ * 헤더와 데이터 섹터만 다시 만듦. 파일을 미리 모두 읽어 두지 않고 구간
+ * 단위로 읽고 쓰며(fs_flush_window), 다른 파일이 차지할 자리를 덮어쓰기 전에
+ * 그 파일을 먼저 옮김: 뒤로 밀리는 파일은 뒤쪽 파일부터, 각 파일 안에서도
+ * 뒤쪽 페이지부터 옮기고, 나머지는 앞에서부터 옮김
+ */
+void fs_flush(void) {
+  uint8_t sector_buf[SECTOR_SIZE];
+  unsigned sector = 0;  // 현재 디스크 섹터 위치를 추적
+  unsigned written = 0; // 디스크에 기록할 섹터 수
+
+  // 잠들지 않은 상태에서 배치를 확정 (기록하는 도중 바뀐 파일은 dirty가 다시
+  // 설정되어 다음 기록의 대상). 파일은 다 옮길 때까지 기존 위치를 유지
+  for (int file_i = 0; file_i < FILES_MAX; file_i++) {
+    struct file *file = &files[file_i];
+    struct fs_flush_slot *slot = &fs_flush_slots[file_i];
+    slot->in_use = file->in_use;
+    slot->rewrite = false;
+    if (!file->in_use)
+      continue;
+
+    slot->sector = sector;
+    slot->old_sector = file->sector;
+    slot->size = file->size;
+    if (file->dirty || file->sector != sector) {
+      slot->rewrite = true;
+      strcpy(slot->name, file->name);
+      file->dirty = false;
+      file->flushing = true;
+      file->flush_sector = sector;
+      // 뒤로 밀리는 파일은 끝에서부터 옮긴 범위를 넓혀 감
+      file->flushed_lo = file->flushed_hi = fs_flush_up(slot) ? slot->size : 0;
+    }
+    sector += fs_file_sectors(file->size);
+  }
+
+  int norder = 0;
+  for (int file_i = FILES_MAX - 1; file_i >= 0; file_i--) {
+    struct fs_flush_slot *slot = &fs_flush_slots[file_i];
+    if (slot->rewrite && fs_flush_up(slot))
+      fs_flush_order[norder++] = file_i;
+  }
+  for (int file_i = 0; file_i < FILES_MAX; file_i++) {
+    struct fs_flush_slot *slot = &fs_flush_slots[file_i];
+    if (slot->rewrite && !fs_flush_up(slot))
+      fs_flush_order[norder++] = file_i;
+  }
+
+  // 구간들을 FS_FLUSH_BATCH 페이지씩 묶어 잠금을 잡고 기록. 기록하는 동안
+  // 페이지가 반환되거나 덮어써지지 않고, 묶음 사이에는 다른 프로세스가 페이지
+  // 캐시를 쓸 수 있음 (옮기는 중인 파일을 자르거나 삭제하면 다 옮길 때까지 대기)
+  struct fs_io io = {0};
+  struct fs_flush_window wins[FS_FLUSH_BATCH];
+  int nwins = 0;
+  uint32_t npages = 0;
+  fs_load_lock();
+  for (int k = 0; k < norder; k++) {
+    int file_i = fs_flush_order[k];
+    struct fs_flush_slot *slot = &fs_flush_slots[file_i];
+    bool up = fs_flush_up(slot);
+    uint32_t total = align_up(slot->size, PAGE_SIZE) / PAGE_SIZE;
+    uint32_t done = 0;
+    do {
+      uint32_t n = total - done;
+      if (n > FS_FLUSH_BATCH - npages)
+        n = FS_FLUSH_BATCH - npages;
+      uint32_t first = up ? total - done - n : done;
+      written += fs_flush_window(&files[file_i], slot, first, first + n, &io);
+      done += n;
+      npages += n;
+      wins[nwins++] = (struct fs_flush_window){
+          .file_i = file_i, .first = first, .end = first + n,
+          .last = done == total};
+
+      if (npages == FS_FLUSH_BATCH || nwins == FS_FLUSH_BATCH) {
+        written += fs_flush_commit(wins, nwins, &io);
+        nwins = 0;
+        npages = 0;
+        fs_load_unlock();
+        yield();
+        fs_load_lock();
+      }
+    } while (done < total);
+  }
+  written += fs_flush_commit(wins, nwins, &io);
+  fs_load_unlock();
+
+  // 아카이브의 끝이 바뀌었으면 그 자리에 빈 헤더를 씀 (빈 헤더가 아카이브의
+  // 끝을 나타내므로 그 뒤의 섹터는 지우지 않아도 됨)
+  if (sector != fs_end_sector) {
+    memset(sector_buf, 0, SECTOR_SIZE);
+    written += fs_write_sector(sector, sector_buf);
+  }
+  fs_end_sector = sector;
+
+  // dirty 헤더 섹터들을 virtio-blk 디바이스에 기록
+  bflush();
+
+  printf("wrote %d sectors to disk\n", written);
+}
+
+struct proc_queue fs_flusher_wq; // flusher 스레드가 잠드는 큐
+struct proc_queue fs_sync_waiters; // fsync로 기록 완료를 기다리는 큐
+unsigned fs_dirty_writes;         // 아직 디스크에 기록되지 않은 쓰기 횟수
+bool fs_sync_requested;           // fsync가 즉시 기록을 요청했는지 여부
+bool fs_flushing;                 // flusher가 기록 중인지 여부
+uint32_t fs_flush_seq;            // 완료된 기록 횟수
+
+// 디스크에 기록할 변경이 생겼음을 알림
+// 첫 쓰기에서 마감 시각을 정하고, 쓰기가 많이 쌓이면 flusher를 바로 깨움
+void fs_schedule_flush(void) {
+  fs_stats.writes++;
+  if (fs_dirty_writes++ == 0)
+    flush_deadline =
+        read_time() + (uint64_t)FS_FLUSH_DELAY_MS * (TIMEBASE_FREQ / 1000);
+  if (fs_dirty_writes >= FS_DIRTY_THRESHOLD)
+    proc_wakeup_all(&fs_flusher_wq);
+}
+
+// 파일 내용이 메모리에서 바뀌었음을 알림
+uint32_t fs_version_seq; // 마지막으로 나눠 준 파일 버전
+
+void fs_mark_dirty(struct file *file) {
+  file->dirty = true;
+  file->version = ++fs_version_seq;
+  fs_schedule_flush();
+}
+
+/**
+ * @brief 빈 파일을 만들고 색인에 추가
+ * 디스크의 파일 순서가 files[] 순서를 따르므로, 마지막으로 사용 중인 칸 뒤의
+ * 빈 칸을 우선 사용해 아카이브 끝에 추가되게 함 (앞쪽 빈 칸을 쓰면 뒤의
+ * 파일들이 모두 밀려서 다시 기록됨)
+ *
+ * @param filename 파일 이름
+ * @return struct file* 만든 파일 (이름이 너무 길거나 빈 칸이 없으면 NULL)
+ */
+struct file *fs_create(const char *filename) {
+  size_t len = 0;
+  while (filename[len])
+    len++;
+  if (len == 0 || len >= sizeof(files[0].name))
+    return NULL;
+
+  // 맨 뒤 칸까지 차 있으면 가장 앞의 빈 칸을 사용
+  int i = fs_last_used + 1 < FILES_MAX ? fs_last_used + 1 : fs_first_free_slot();
+
+  // 헤더 섹터와 아카이브 끝을 나타내는 빈 헤더 자리가 있어야 함
+  if (i < 0 || fs_used_sectors + fs_file_sectors(0) + 1 >
+                   blk_capacity / SECTOR_SIZE)
+    return NULL;
+
+  struct file *file = &files[i];
+  fs_slot_mark(i, false);
+  if (i > fs_last_used)
+    fs_last_used = i;
+
+  memset(file, 0, sizeof(*file));
+  file->in_use = true;
+  strcpy(file->name, filename);
+  file->hash = fs_name_hash(filename);
+  file->sector = BCACHE_NO_SECTOR; // 아직 디스크에 위치가 없음
+  file->version = ++fs_version_seq; // 같은 칸을 쓰던 파일의 캐시와 구별
+  fs_used_sectors += fs_file_sectors(0);
+  fs_index_insert(file);
+  return file;
+}
+
+// 파일을 삭제. 페이지 캐시를 반환하고, 뒤의 파일들은 다음 기록 때 당겨짐
+int fs_delete(const char *filename) {
+  int slot = fs_index_find(filename, fs_name_hash(filename));
+  if (slot < 0)
+    return -1;
+
+  // 열려 있는 파일은 삭제하지 않음
+  struct file *file = &files[fs_index[slot]];
+  if (file->open_count > 0)
+    return -1;
+
+  fs_truncate(file, 0);
+  fs_free_index(file);
+  fs_used_sectors -= fs_file_sectors(0);
+  memset(file, 0, sizeof(*file));
+  fs_index[slot] = FS_INDEX_DELETED;
+  if (++fs_index_deleted > FS_INDEX_DELETED_MAX)
+    fs_index_rebuild();
+
+  // 맨 뒤 칸이 비었으면 사용 중인 마지막 칸까지 당김 (당긴 칸들은 다음
+  // 생성에서 다시 쓰이므로 생성/삭제당 평균 O(1))
+  int i = file - files;
+  fs_slot_mark(i, true);
+  while (fs_last_used >= 0 && !files[fs_last_used].in_use)
+    fs_last_used--;
+
+  // 아카이브가 줄어들었으므로 기록을 예약
+  fs_schedule_flush();
+  return 0;
+}
+
+// 타이머 인터럽트마다 호출, 지연 쓰기 마감 시각이 지났으면 flusher를 깨움
+void fs_timer_tick(void) {
+  if (flush_deadline && read_time() >= flush_deadline) {
+    flush_deadline = 0;
+    proc_wakeup_all(&fs_flusher_wq);
+  }
+}
+
+// 지금 디스크에 기록해야 하는지 판단 (fsync 요청, 쓰기 임계값, 마감 시각)
+bool fs_flush_due(void) {
+  return fs_sync_requested ||
+         (fs_dirty_writes > 0 &&
+          (fs_dirty_writes >= FS_DIRTY_THRESHOLD || !flush_deadline));
+}
+
+/**
+ * @brief 지연된 파일 쓰기를 모아서 디스크에 기록하는 커널 스레드
+ * writefile은 메모리의 파일 내용만 바꾸고 리턴하며, 그동안 쌓인 쓰기들은
+ * 이 스레드가 fs_flush 한 번으로 묶어서 기록 (group commit)
+ */
+void fs_flusher_entry(void) {
+  for (;;) {
+    while (!fs_flush_due())
+      proc_sleep(&fs_flusher_wq);
+
+    // 기록 중에 들어온 쓰기는 다음 기록의 대상
+    fs_dirty_writes = 0;
+    fs_sync_requested = false;
+    flush_deadline = 0;
+
+    fs_flushing = true;
+    fs_flush();
+    fs_flushing = false;
+    fs_flush_seq++;
+    fs_stats.flushes++;
+    proc_wakeup_all(&fs_sync_waiters);
+  }
+}
+
+// 지금까지의 파일 쓰기가 모두 디스크에 기록될 때까지 대기
+void fs_sync(void) {
+  fs_stats.syncs++;
+  if (fs_dirty_writes == 0 && !fs_flushing)
+    return;
+
+  // 이미 진행 중인 기록은 그 이후의 쓰기를 포함하지 않을 수 있으므로
+  // 그다음 기록까지 기다림
+  uint32_t target = fs_flush_seq + (fs_flushing ? 2 : 1);
+  fs_sync_requested = true;
+  proc_wakeup_all(&fs_flusher_wq);
+  while (fs_flush_seq < target)
+    proc_sleep(&fs_sync_waiters);
+}
+
+// 파일 시스템 통계 출력
+void fs_dump_stats(void) {
+  printf("fs: writes=%d flushes=%d syncs=%d sector_loads=%d ra_sectors=%d "
+         "evictions=%d cached_pages=%d\n",
+         fs_stats.writes, fs_stats.flushes, fs_stats.syncs,
+         fs_stats.sector_loads, fs_stats.ra_sectors, fs_stats.evictions,
+         fs_cache_pages);
+}
+
+// 현재 프로세스의 파일 디스크립터에 해당하는 열린 파일 (잘못된 번호면 NULL)
+struct open_file *fd_get(int fd) {
+  if (fd < 0 || fd >= FDS_MAX || !current_proc->fds[fd].file)
+    return NULL;
+  return &current_proc->fds[fd];
+}
+
+/**
+ * @brief 파일을 열어 파일 디스크립터를 할당
+ *
+ * @param filename 파일 이름
+ * @param flags O_CREAT, O_TRUNC의 조합
+ * @return int 파일 디스크립터 (파일이 없거나 디스크립터가 모자라면 -1)
+ */
+int fd_open(const char *filename, int flags) {
+  int fd = 0;
+  while (fd < FDS_MAX && current_proc->fds[fd].file)
+    fd++;
+  if (fd == FDS_MAX)
+    return -1;
+
+  struct file *file = fs_lookup(filename);
+  if (!file && (flags & O_CREAT))
+    file = fs_create(filename);
+  if (!file)
+    return -1;
+
+  file->open_count++;
+  current_proc->fds[fd].file = file;
+  current_proc->fds[fd].offset = 0;
+  if (flags & O_TRUNC) {
+    fs_truncate(file, 0);
+    fs_mark_dirty(file);
+  }
+  return fd;
+}
+
+// 파일 디스크립터를 닫음
+int fd_close(int fd) {
+  struct open_file *of = fd_get(fd);
+  if (!of)
+    return -1;
+
+  of->file->open_count--;
+  of->file = NULL;
+  return 0;
+}
+
+// 파일 오프셋을 옮김. 파일 끝을 넘어가면 그 뒤에 쓸 때 사이가 0으로 채워짐
+int fd_lseek(int fd, int offset, int whence) {
+  struct open_file *of = fd_get(fd);
+  if (!of)
+    return -1;
+
+  int base;
+  switch (whence) {
+  case SEEK_SET:
+    base = 0;
+    break;
+  case SEEK_CUR:
+    base = of->offset;
+    break;
+  case SEEK_END:
+    base = of->file->size;
+    break;
+  default:
+    return -1;
+  }
+
+  int pos = base + offset;
+  if (pos < 0 || (uint32_t)pos > FILE_SIZE_MAX)
+    return -1;
+  of->offset = pos;
+  return pos;
+}
+
+struct vm_stats vm_stats;
+struct image images[IMAGES_MAX];
+
+// 이미지가 가진 페이지를 모두 반환하고 빈 칸으로 만듦
+void image_free(struct image *image) {
+  if (image->pages) {
+    for (uint32_t idx = 0; idx < IMAGE_PAGES_MAX; idx++) {
+      if (image->pages[idx])
+        page_put(image->pages[idx]);
+    }
+    free_pages((paddr_t)image->pages,
+               IMAGE_PAGES_MAX * sizeof(paddr_t) / PAGE_SIZE);
+  }
+  if (image->file)
+    free_pages((paddr_t)image->data, image->npages);
+  memset(image, 0, sizeof(*image));
+}
+
+// 사용하는 프로세스가 없는 이미지를 캐시에서 내보내고 그 칸을 리턴
+// (모두 사용 중이면 NULL)
+struct image *image_evict(void) {
+  for (int i = 0; i < IMAGES_MAX; i++) {
+    if (images[i].data && images[i].refs == 0) {
+      image_free(&images[i]);
+      vm_stats.image_evicts++;
+      return &images[i];
+    }
+  }
+  return NULL;
+}
+
+// ELF 세그먼트 플래그를 페이지 속성으로 변환
+uint32_t elf_page_flags(uint32_t pflags) {
+  return ((pflags & PF_R) ? PAGE_R : 0) | ((pflags & PF_W) ? PAGE_W : 0) |
+         ((pflags & PF_X) ? PAGE_X : 0);
+}
+
+/**
+ * @brief ELF 실행 파일을 검사해 실행 이미지로 등록
+ * PT_LOAD 세그먼트의 위치와 속성만 기록하고 내용은 복사하지 않음
+ * 같은 data로 이미 등록된 이미지가 있으면 그 이미지를 공유
+ *
+ * @param data ELF 파일 내용 (이미지를 사용하는 동안 유지되어야 함)
+ * @param size ELF 파일 크기
+ * @return struct image* 이미지 (형식이 잘못되었거나 빈 칸이 없으면 NULL)
+ */
+struct image *image_load(const uint8_t *data, size_t size) {
+  struct image *image = NULL;
+  for (int i = 0; i < IMAGES_MAX; i++) {
+    if (images[i].data && images[i].data == data)
+      return &images[i];
+    if (!images[i].data && !image)
+      image = &images[i];
+  }
+  if (!image)
+    image = image_evict();
+
+  // 정렬되지 않은 위치일 수 있으므로 헤더는 복사해서 읽음
+  struct elf32_ehdr ehdr;
+  if (!image || size < sizeof(ehdr))
+    return NULL;
+  memcpy(&ehdr, data, sizeof(ehdr));
+  if (ehdr.magic != ELF_MAGIC || ehdr.class != ELFCLASS32 ||
+      ehdr.machine != EM_RISCV ||
+      ehdr.phentsize != sizeof(struct elf32_phdr) || ehdr.phoff > size ||
+      ehdr.phnum > (size - ehdr.phoff) / sizeof(struct elf32_phdr))
+    return NULL;
+
+  memset(image, 0, sizeof(*image));
+  for (int i = 0; i < ehdr.phnum; i++) {
+    struct elf32_phdr ph;
+    memcpy(&ph, data + ehdr.phoff + i * sizeof(ph), sizeof(ph));
+    if (ph.type != PT_LOAD || ph.memsz == 0)
+      continue;
+
+    // 세그먼트는 파일 안에 있어야 하고 사용자 영역에 올라가야 함
+    if (image->nsegs == IMAGE_SEGS_MAX || ph.filesz > ph.memsz ||
+        ph.offset > size || ph.filesz > size - ph.offset ||
+        ph.vaddr < USER_BASE || ph.vaddr >= USER_END ||
+        ph.memsz > USER_END - ph.vaddr)
+      return NULL;
+
+    struct image_seg *seg = &image->segs[image->nsegs++];
+    seg->vaddr = ph.vaddr;
+    seg->memsz = ph.memsz;
+    seg->filesz = ph.filesz;
+    seg->offset = ph.offset;
+    seg->flags = elf_page_flags(ph.flags);
+  }
+
+  if (image->nsegs == 0 || ehdr.entry < USER_BASE || ehdr.entry >= USER_END)
+    return NULL;
+
+  image->data = data;
+  image->size = size;
+  image->entry = ehdr.entry;
+  return image;
+}
+
+// 이미지 파일에서 va 페이지에 해당하는 내용을 page로 복사
+// 파일에 내용이 없는 부분(bss 등)은 그대로 둠. 복사한 내용이 있으면 true
+bool image_fill(struct image *image, vaddr_t va, uint8_t *page) {
+  bool copied = false;
+  for (int i = 0; i < image->nsegs; i++) {
+    struct image_seg *seg = &image->segs[i];
+    vaddr_t start = va > seg->vaddr ? va : seg->vaddr;
+    vaddr_t end = seg->vaddr + seg->filesz;
+    if (va + PAGE_SIZE < end)
+      end = va + PAGE_SIZE;
+    if (start >= end)
+      continue;
+
+    memcpy(page + (start - va), image->data + seg->offset + (start - seg->vaddr),
+           end - start);
+    copied = true;
+  }
+  return copied;
+}
+
+/**
+ * @brief 이미지의 va 페이지를 매핑할 물리 페이지를 준비
+ * 읽기 전용 세그먼트의 페이지는 이미지에 하나만 만들어 두고 모든 인스턴스가
+ * 공유 (참조 수 증가). 쓰기 가능한 세그먼트의 페이지는 프로세스마다 새로 만들어
+ * 파일 내용을 복사하고, 어느 세그먼트에도 속하지 않는 페이지는 0으로 채움
+ *
+ * @param image 실행 이미지
+ * @param va 페이지의 가상 주소
+ * @param flags 매핑할 때 사용할 페이지 속성을 돌려받을 곳
+ * @return paddr_t 매핑할 물리 페이지
+ */
+paddr_t image_map_page(struct image *image, vaddr_t va, uint32_t *flags) {
+  // 페이지에 걸친 세그먼트들의 속성을 합침
+  uint32_t f = 0;
+  for (int i = 0; i < image->nsegs; i++) {
+    struct image_seg *seg = &image->segs[i];
+    if (seg->vaddr < va + PAGE_SIZE && va < seg->vaddr + seg->memsz)
+      f |= seg->flags;
+  }
+
+  if (!f || (f & PAGE_W)) {
+    *flags = f | PAGE_R | PAGE_W;
+    paddr_t page = alloc_pages(1); // 0으로 채워져 있음
+    if (image_fill(image, va, (uint8_t *)page))
+      vm_stats.image_copies++;
+    else
+      vm_stats.zero_fills++;
+    return page;
+  }
+
+  uint32_t idx = (va - USER_BASE) / PAGE_SIZE;
+  if (!image->pages)
+    image->pages = (paddr_t *)alloc_pages(IMAGE_PAGES_MAX * sizeof(paddr_t) /
+                                          PAGE_SIZE);
+  if (!image->pages[idx]) {
+    image->pages[idx] = alloc_pages(1);
+    image_fill(image, va, (uint8_t *)image->pages[idx]);
+    vm_stats.text_loads++;
+  }
+
+  *flags = f;
+  page_get(image->pages[idx]);
+  vm_stats.text_shares++;
+  return image->pages[idx];
+}
+
+// vaddr을 포함하는 프로세스의 mmap 영역 (없으면 NULL)
+struct vm_area *vm_find(struct process *proc, vaddr_t vaddr) {
+  for (int i = 0; i < VMAS_MAX; i++) {
+    struct vm_area *vma = &proc->vmas[i];
+    if (vma->end && vma->start <= vaddr && vaddr < vma->end)
+      return vma;
+  }
+  return NULL;
+}
+
+/**
+ * @brief 현재 프로세스의 페이지 폴트를 처리 (요구 페이징)
+ * [USER_BASE, USER_END) 영역이면 실행 이미지의 페이지를 매핑 (image_map_page)
+ * mmap 영역이면 파일의 페이지 캐시에서 해당 페이지를 가져와(필요하면 디스크에서
+ * 읽음) 복사 없이 그대로 매핑. 처음에는 읽기 전용으로 매핑하고 쓰기 폴트가 나면
+ * 쓰기를 허용하므로, PAGE_W가 켜진 엔트리가 곧 바뀐(dirty) 페이지가 됨
+ *
+ * @param vaddr 폴트가 난 가상 주소
+ * @param access 접근 종류 (PAGE_R, PAGE_W, PAGE_X 중 하나)
+ * @return bool 매핑했으면 true, 잘못된 접근이면 false
+ */
+bool vm_fault(vaddr_t vaddr, uint32_t access) {
+  struct process *proc = current_proc;
+  vaddr_t va = vaddr & ~(PAGE_SIZE - 1);
+  if (USER_BASE <= va && va < USER_END) {
+    uint32_t *pte = page_table_entry(proc->page_table, va);
+    if (pte && (*pte & PAGE_V)) {
+      // 이미 허용된 접근이면 TLB에 남은 이전 엔트리 때문에 난 폴트
+      if (*pte & access) {
+        tlb_flush_page(va);
+        return true;
+      }
+      if (access != PAGE_W || !(*pte & PAGE_COW))
+        return false;
+
+      // fork 이후 공유 중인 페이지에 쓰기: 다른 쪽이 모두 놓았으면 그대로
+      // 쓰기를 허용하고, 아니면 복사본을 만들어 이 프로세스만 바꿈
+      paddr_t page = (*pte >> 10) * PAGE_SIZE;
+      if (paddr_to_page(page)->refs > 1) {
+        paddr_t copy = alloc_pages(1);
+        memcpy((void *)copy, (void *)page, PAGE_SIZE);
+        page_put(page);
+        page = copy;
+        vm_stats.cow_copies++;
+      } else {
+        vm_stats.cow_reuses++;
+      }
+      map_page(proc->page_table, va, page,
+               (*pte & (PAGE_U | PAGE_R | PAGE_X)) | PAGE_W);
+    } else {
+      uint32_t flags;
+      paddr_t page = image_map_page(proc->image, va, &flags);
+      map_page(proc->page_table, va, page, PAGE_U | flags);
+    }
+
+    tlb_flush_page(va);
+    vm_stats.faults++;
+    return true;
+  }
+
+  // 파일 매핑은 실행할 수 없음
+  bool is_write = access == PAGE_W;
+  struct vm_area *vma = vm_find(proc, vaddr);
+  if (!vma || access == PAGE_X || (is_write && !(vma->prot & PROT_WRITE)))
+    return false;
+
+  uint8_t *page = fs_get_page(vma->file, (va - vma->start) / PAGE_SIZE, 0,
+                              PAGE_SIZE, false);
+  map_page(proc->page_table, va, (paddr_t)page,
+           PAGE_U | PAGE_R | (is_write ? PAGE_W : 0));
+  tlb_flush_page(va);
+  vm_stats.faults++;
+  vm_stats.file_maps++;
+  return true;
+}
+
+// 커널이 사용자 버퍼에 접근하기 전에 매핑되지 않은 페이지를 미리 채움
+// (커널 모드에서 페이지 폴트가 나면 처리할 수 없음)
+// 이미지의 문자열 상수처럼 사용자가 아직 건드리지 않은 페이지일 수 있음
+bool user_prepare(vaddr_t vaddr, int len, bool is_write) {
+  if (len < 0)
+    return false;
+  if (len == 0)
+    return true;
+
+  vaddr_t end = vaddr + len;
+  if (end < vaddr)
+    return false;
+
+  for (vaddr_t va = vaddr & ~(PAGE_SIZE - 1); va < end; va += PAGE_SIZE) {
+    uint32_t *pte = page_table_entry(current_proc->page_table, va);
+    uint32_t need = PAGE_V | PAGE_U | (is_write ? PAGE_W : PAGE_R);
+    if ((!pte || (*pte & need) != need) &&
+        !vm_fault(va, is_write ? PAGE_W : PAGE_R))
+      return false;
+  }
+  return true;
+}
+
+// 사용자 문자열이 끝나는 곳까지 페이지를 미리 채움
+bool user_prepare_str(vaddr_t str) {
+  for (;;) {
+    if (!user_prepare(str, 1, false))
+      return false;
+
+    // 페이지 안에서 문자열이 끝나면 완료, 아니면 다음 페이지로
+    vaddr_t end = (str & ~(PAGE_SIZE - 1)) + PAGE_SIZE;
+    for (; str < end; str++) {
+      if (*(const char *)str == '\0')
+        return true;
+    }
+    if (str == 0)
+      return false;
+  }
+}
+
+/**
+ * @brief 파일을 현재 프로세스의 주소 공간에 매핑
+ * 페이지는 매핑하지 않고 영역만 기록해 두며, 처음 접근할 때 페이지 폴트에서
+ * 채움. 매핑이 살아 있는 동안 파일은 열린 것으로 취급되어 삭제되지 않음
+ *
+ * @param fd 파일 디스크립터
+ * @param len 매핑할 길이 (파일의 처음부터, 파일의 마지막 페이지까지 가능)
+ * @param prot PROT_READ, PROT_WRITE의 조합 (매핑은 항상 읽을 수 있음)
+ * @return int 매핑한 주소 (실패하면 -1)
+ */
+int vm_mmap(int fd, uint32_t len, int prot) {
+  struct open_file *of = fd_get(fd);
+  if (!of || len == 0 || len > align_up(of->file->size, PAGE_SIZE) ||
+      (prot & ~(PROT_READ | PROT_WRITE)))
+    return -1;
+
+  // 기존 영역들 뒤에 이어서 배치
+  struct vm_area *vma = NULL;
+  vaddr_t start = MMAP_BASE;
+  for (int i = 0; i < VMAS_MAX; i++) {
+    struct vm_area *v = &current_proc->vmas[i];
+    if (!v->end && !vma)
+      vma = v;
+    if (v->end > start)
+      start = v->end;
+  }
+
+  if (!vma || MMAP_END - start < align_up(len, PAGE_SIZE))
+    return -1;
+
+  vma->start = start;
+  vma->end = start + align_up(len, PAGE_SIZE);
+  vma->file = of->file;
+  vma->prot = prot | PROT_READ;
+  of->file->open_count++;
+  of->file->map_count++;
+  return start;
+}
+
+// 영역에서 쓰기가 허용된(바뀐) 페이지를 다시 읽기 전용으로 돌림
+// 바뀐 페이지가 있었으면 파일을 dirty로 표시. unmap이면 매핑 자체를 지움
+void vm_collect_dirty(struct vm_area *vma, vaddr_t start, vaddr_t end,
+                      bool unmap) {
+  bool dirty = false;
+  for (vaddr_t va = start; va < end; va += PAGE_SIZE) {
+    uint32_t *pte = page_table_entry(current_proc->page_table, va);
+    if (!pte || !(*pte & PAGE_V))
+      continue;
+
+    // 쓰기가 허용되었던 페이지는 다음 기록에서 디스크에 씀
+    if (*pte & PAGE_W) {
+      *fs_page_entry(vma->file, (va - vma->start) / PAGE_SIZE, false) |=
+          FILE_PAGE_DIRTY;
+      dirty = true;
+    }
+    if (unmap)
+      *pte = 0;
+    else
+      *pte &= ~PAGE_W;
+    tlb_flush_page(va);
+  }
+
+  if (dirty)
+    fs_mark_dirty(vma->file);
+}
+
+// 매핑을 해제하고 파일 사용 표시를 돌려놓음
+void vm_unmap(struct vm_area *vma) {
+  vm_collect_dirty(vma, vma->start, vma->end, true);
+  vma->file->open_count--;
+  vma->file->map_count--;
+  vma->end = 0;
+}
+
+// addr에서 시작하는 매핑을 해제
+int vm_munmap(vaddr_t addr) {
+  struct vm_area *vma = vm_find(current_proc, addr);
+  if (!vma || vma->start != addr)
+    return -1;
+
+  vm_unmap(vma);
+  return 0;
+}
+
+// [addr, addr + len) 범위에서 바뀐 페이지를 파일에 반영하고 디스크에
+// 기록될 때까지 대기
+int vm_msync(vaddr_t addr, uint32_t len) {
+  vaddr_t end = addr + len;
+  if (end < addr)
+    return -1;
+
+  bool found = false;
+  for (int i = 0; i < VMAS_MAX; i++) {
+    struct vm_area *vma = &current_proc->vmas[i];
+    if (!vma->end || vma->end <= addr || end <= vma->start)
+      continue;
+
+    vaddr_t s = addr > vma->start ? addr & ~(PAGE_SIZE - 1) : vma->start;
+    vaddr_t e = end < vma->end ? end : vma->end;
+    vm_collect_dirty(vma, s, e, false);
+    found = true;
+  }
+
+  if (!found)
+    return -1;
+  fs_sync();
+  return 0;
+}
+
+// 파일의 ELF 헤더와 프로그램 헤더만 읽어 검사하고, 헤더와 PT_LOAD 세그먼트가
+// 차지하는 파일 앞부분의 크기를 리턴 (ELF 형식이 아니면 0)
+size_t image_file_extent(struct file *file) {
+  struct elf32_ehdr ehdr;
+  if (fs_read(file, 0, &ehdr, sizeof(ehdr)) != sizeof(ehdr) ||
+      ehdr.magic != ELF_MAGIC || ehdr.class != ELFCLASS32 ||
+      ehdr.machine != EM_RISCV ||
+      ehdr.phentsize != sizeof(struct elf32_phdr) || ehdr.phoff > file->size ||
+      ehdr.phnum > (file->size - ehdr.phoff) / sizeof(struct elf32_phdr))
+    return 0;
+
+  size_t extent = ehdr.phoff + ehdr.phnum * sizeof(struct elf32_phdr);
+  if (extent < sizeof(ehdr))
+    extent = sizeof(ehdr);
+  for (int i = 0; i < ehdr.phnum; i++) {
+    struct elf32_phdr ph;
+    if (fs_read(file, ehdr.phoff + i * sizeof(ph), &ph, sizeof(ph)) !=
+        sizeof(ph))
+      return 0;
+    if (ph.type != PT_LOAD || ph.memsz == 0)
+      continue;
+    if (ph.offset > file->size || ph.filesz > file->size - ph.offset)
+      return 0;
+    if (ph.offset + ph.filesz > extent)
+      extent = ph.offset + ph.filesz;
+  }
+  return extent;
+}
+
+/**
+ * @brief 파일 시스템의 ELF 파일로 실행 이미지를 준비
+ * 같은 버전의 파일로 만든 이미지가 캐시에 있으면 디스크를 읽지 않고 재사용
+ * 없으면 헤더를 먼저 검사한 뒤, 헤더와 세그먼트가 차지하는 부분만 연속된
+ * 페이지로 읽어 와 이미지로 등록. 메모리가 모자라면 실패를 리턴 (PANIC 없음)
+ *
+ * @param filename 파일 이름
+ * @return struct image* 이미지 (파일이 없거나 ELF 형식이 아니면 NULL)
+ */
+struct image *image_open(const char *filename) {
+  struct file *file = fs_lookup(filename);
+  if (!file || file->size == 0)
+    return NULL;
+
+  for (int i = 0; i < IMAGES_MAX; i++) {
+    if (images[i].data && images[i].file == file &&
+        images[i].version == file->version) {
+      vm_stats.image_hits++;
+      return &images[i];
+    }
+  }
+
+  // 읽는 동안 잠들 수 있으므로 파일이 삭제되지 않게 사용 중으로 표시
+  uint32_t version = file->version;
+  file->open_count++;
+  size_t extent = image_file_extent(file);
+  uint32_t npages = align_up(extent, PAGE_SIZE) / PAGE_SIZE;
+  uint8_t *data = extent ? (uint8_t *)try_alloc_pages(npages) : NULL;
+  if (!data) {
+    file->open_count--;
+    return NULL;
+  }
+  int len = fs_read(file, 0, data, extent);
+  file->open_count--;
+
+  // 읽는 사이에 파일이 바뀌었으면 섞인 내용일 수 있음
+  struct image *image = NULL;
+  if (file->version == version)
+    image = image_load(data, len);
+  if (!image) {
+    free_pages((paddr_t)data, npages);
+    return NULL;
+  }
+
+  image->file = file;
+  image->version = version;
+  image->npages = npages;
+  vm_stats.image_reads++;
+  return image;
+}
+
+// 빈 프로세스 슬롯이 있는지 확인 (create_process는 슬롯이 없으면 PANIC)
+bool proc_slot_available(void) {
+  proc_reap_orphans();
+  return kstack_free_count > 0;
+}
+
+// child를 현재 프로세스의 자식으로 등록 (종료하면 wait으로 회수)
+void proc_add_child(struct process *child) {
+  child->parent = current_proc;
+  child->sibling = current_proc->children;
+  current_proc->children = child;
+}
+
+// 파일 시스템의 프로그램을 새 프로세스로 실행, 새 프로세스의 pid를 리턴
+int proc_spawn(const char *filename) {
+  if (!proc_slot_available())
+    return -1;
+
+  struct image *image = image_open(filename);
+  // 이미지를 읽는 동안 다른 프로세스가 슬롯을 가져갔을 수 있음
+  if (!image || !proc_slot_available())
+    return -1;
+
+  struct process *proc = create_process(image, user_entry);
+  proc_add_child(proc);
+  vm_stats.spawns++;
+  return proc->pid;
+}
+
+// 가상 메모리 통계 출력
+void vm_dump_stats(void) {
+  printf("vm: faults=%d zero_fills=%d image_copies=%d file_maps=%d kills=%d\n",
+         vm_stats.faults, vm_stats.zero_fills, vm_stats.image_copies,
+         vm_stats.file_maps, vm_stats.kills);
+  printf("vm: text_loads=%d text_shares=%d\n", vm_stats.text_loads,
+         vm_stats.text_shares);
+  printf("vm: spawns=%d image_hits=%d image_reads=%d image_evicts=%d\n",
+         vm_stats.spawns, vm_stats.image_hits, vm_stats.image_reads,
+         vm_stats.image_evicts);
+  printf("vm: forks=%d cow_copies=%d cow_reuses=%d\n", vm_stats.forks,
+         vm_stats.cow_copies, vm_stats.cow_reuses);
+}
+
+/**
+ * @brief 현재 프로세스를 복제 (쓰기 시 복사)
+ * 사용자 페이지는 복사하지 않고 자식의 페이지 테이블에 같은 물리 페이지를
+ * 매핑하며, 쓰기 가능한 페이지는 양쪽 모두 읽기 전용 + PAGE_COW로 바꿈
+ * 어느 쪽이든 쓰려고 하면 vm_fault에서 그 페이지만 복사하므로, 비용은 주소
+ * 공간 크기가 아니라 이미 매핑된 페이지 테이블 엔트리 수에 비례
+ * mmap 영역은 같은 파일을 공유하도록 영역만 복사 (자식은 접근할 때 다시 매핑)
+ *
+ * @param f 부모의 trap_frame (자식은 a0만 0으로 바꾼 채 같은 지점으로 복귀)
+ * @param user_pc 자식이 복귀할 사용자 주소
+ * @return int 자식의 pid (빈 프로세스 슬롯이 없으면 -1)
+ */
+int proc_fork(struct trap_frame *f, uint32_t user_pc) {
+  struct process *parent = current_proc;
+  if (!proc_slot_available())
+    return -1;
+
+  struct process *child = create_process(NULL, NULL);
+  child->image = parent->image;
+  child->image->refs++;
+  child->priority = parent->priority;
+
+  for (uint32_t vpn1 = USER_BASE >> 22; vpn1 < USER_END >> 22; vpn1++) {
+    if (!(parent->page_table[vpn1] & PAGE_V))
+      continue;
+
+    uint32_t *table0 =
+        (uint32_t *)((parent->page_table[vpn1] >> 10) * PAGE_SIZE);
+    for (uint32_t vpn0 = 0; vpn0 < PAGE_SIZE / 4; vpn0++) {
+      uint32_t *pte = &table0[vpn0];
+      if (!(*pte & PAGE_V))
+        continue;
+
+      if (*pte & PAGE_W)
+        *pte = (*pte & ~PAGE_W) | PAGE_COW;
+      page_get((*pte >> 10) * PAGE_SIZE);
+      map_page(child->page_table, (vpn1 << 22) | (vpn0 << 12),
+               (*pte >> 10) * PAGE_SIZE, *pte & 0x3ff);
+    }
+  }
+
+  // 부모의 TLB에 남은 쓰기 가능한 엔트리를 무효화
+  __asm__ __volatile__("sfence.vma zero, %[asid]" ::[asid] "r"(parent->asid)
+                       : "memory");
+
+  for (int fd = 0; fd < FDS_MAX; fd++) {
+    child->fds[fd] = parent->fds[fd];
+    if (child->fds[fd].file)
+      child->fds[fd].file->open_count++;
+  }
+  for (int i = 0; i < VMAS_MAX; i++) {
+    child->vmas[i] = parent->vmas[i];
+    if (child->vmas[i].end) {
+      child->vmas[i].file->open_count++;
+      child->vmas[i].file->map_count++;
+    }
+  }
+
+  // 커널 스택 맨 위에 trap_frame 복사본을 두고, 그 아래에 switch_context가
+  // 복원할 레지스터를 쌓아 첫 전환 때 fork_child_entry로 가게 함
+  struct trap_frame *tf =
+      (struct trap_frame *)(child->kstack_paddr + KSTACK_SIZE) - 1;
+  *tf = *f;
+  tf->a0 = 0; // 자식에서 fork의 리턴값
+  uint32_t *sp = (uint32_t *)tf;
+  for (int i = 0; i < 11; i++)
+    *--sp = 0;                        // s11 ~ s1
+  *--sp = user_pc;                    // s0
+  *--sp = (uint32_t)fork_child_entry; // ra
+  child->sp = kstack_vaddr(child, sp);
+
+  vm_stats.forks++;
+  proc_add_child(child);
+  runqueue_add(child, child->priority);
+  return child->pid;
+}
+
+/**
+ * @brief 현재 프로세스의 사용자 주소 공간을 반환
+ * 이미지/스택 영역의 페이지는 참조를 내려놓고(공유 중이면 남음), 2단계 페이지
+ * 테이블은 모두 반환. mmap 영역의 페이지는 파일의 페이지 캐시이므로 반환하지
+ * 않음 (vm_unmap으로 이미 엔트리를 지운 뒤 호출)
+ * 1단계 페이지 테이블은 아직 satp가 가리키고 있으므로 회수할 때 반환
+ */
+void vm_free_user(struct process *proc) {
+  for (uint32_t vpn1 = USER_BASE >> 22; vpn1 < MMAP_END >> 22; vpn1++) {
+    if (!(proc->page_table[vpn1] & PAGE_V))
+      continue;
+
+    uint32_t *table0 = (uint32_t *)((proc->page_table[vpn1] >> 10) * PAGE_SIZE);
+    if (vpn1 < USER_END >> 22) {
+      for (uint32_t vpn0 = 0; vpn0 < PAGE_SIZE / 4; vpn0++) {
+        if (table0[vpn0] & PAGE_V)
+          page_put((table0[vpn0] >> 10) * PAGE_SIZE);
+      }
+    }
+    free_pages((paddr_t)table0, 1);
+    proc->page_table[vpn1] = 0;
+  }
+
+  // 반환한 페이지를 가리키는 TLB 엔트리를 무효화
+  __asm__ __volatile__("sfence.vma zero, %[asid]" ::[asid] "r"(proc->asid)
+                       : "memory");
+}
+
+/**
+ * @brief 현재 프로세스를 종료하고 다시 돌아오지 않음
+ * 매핑, 파일 디스크립터, 사용자 페이지를 바로 반환하고 좀비로 남아 부모가
+ * wait으로 회수할 때 슬롯을 돌려줌. 부모가 없으면 다음 슬롯 할당 때 회수
+ * 자식 중 이미 종료한 것은 여기서 회수하고, 실행 중인 것은 부모 없이 남김
+ */
+void proc_exit(void) {
+  struct process *proc = current_proc;
+  for (int i = 0; i < VMAS_MAX; i++) {
+    if (proc->vmas[i].end)
+      vm_unmap(&proc->vmas[i]);
+  }
+  for (int fd = 0; fd < FDS_MAX; fd++)
+    fd_close(fd);
+  vm_free_user(proc);
+  if (proc->image) {
+    proc->image->refs--; // 이미지는 캐시에 남음
+    proc->image = NULL;
+  }
+
+  while (proc->children) {
+    struct process *child = proc->children;
+    proc->children = child->sibling;
+    child->parent = NULL;
+    if (child->state == PROC_EXITED)
+      proc_free(child);
+  }
+
+  printf("process %d exited\n", proc->pid);
+  proc->state = PROC_EXITED;
+  sched_stats.exits++;
+  if (proc->parent) {
+    proc_wakeup_all(&proc->parent->wait_queue);
+  } else {
+    proc->next = proc_orphans;
+    proc_orphans = proc;
+  }
+  yield();
+  PANIC("unreachable");
+}
+
+/**
+ * @brief 자식 프로세스가 종료할 때까지 기다렸다가 회수
+ *
+ * @param pid 기다릴 자식의 pid (-1이면 아무 자식이나)
+ * @return int 회수한 자식의 pid (해당하는 자식이 없으면 -1)
+ */
+int proc_wait(int pid) {
+  for (;;) {
+    bool found = false;
+    for (struct process **pp = &current_proc->children; *pp;
+         pp = &(*pp)->sibling) {
+      struct process *child = *pp;
+      if (pid != -1 && child->pid != pid)
+        continue;
+
+      found = true;
+      if (child->state == PROC_EXITED) {
+        *pp = child->sibling;
+        int child_pid = child->pid;
+        proc_free(child);
+        return child_pid;
+      }
+    }
+
+    if (!found)
+      return -1;
+    proc_sleep(&current_proc->wait_queue);
+  }
+}
+
+// 시스템 콜의 종류를 판별하여 처리
+void handle_syscall(struct trap_frame *f) {
+  // 시스템 콜 번호가 담긴 a3 레지스터 확인
+  // ref: user.c, syscall 함수
+  switch (f->a3) {
+  case SYS_EXIT:
+    proc_exit();
+  case SYS_GETCHAR:
+    while (1) {
+      long ch = getchar();
+      if (ch >= 0) {
+        f->a0 = ch;
+        break;
+      }
+
+      // 입력이 없으면 UART 인터럽트가 깨워줄 때까지 잠듦
+      proc_sleep(&console_waiters);
+    }
+    break;
+
+  case SYS_PUTCHAR:
     putchar(f->a0);
     break;
+  case SYS_KSTATS:
+    pages_dump_stats();
+    tlb_dump_stats();
+    vm_dump_stats();
+    sched_dump_stats();
+    blk_dump_stats();
+    bcache_dump_stats();
+    fs_dump_stats();
+    break;
+  case SYS_FSYNC:
+    fs_sync();
+    f->a0 = 0;
+    break;
+  case SYS_UNLINK:
+    f->a0 = user_prepare_str(f->a0) ? fs_delete((const char *)f->a0) : -1;
+    break;
+  case SYS_OPEN:
+    f->a0 = user_prepare_str(f->a0) ? fd_open((const char *)f->a0, f->a1) : -1;
+    break;
+  case SYS_CLOSE:
+    f->a0 = fd_close(f->a0);
+    break;
+  case SYS_LSEEK:
+    f->a0 = fd_lseek(f->a0, f->a1, f->a2);
+    break;
+  case SYS_MMAP:
+    f->a0 = vm_mmap(f->a0, f->a1, f->a2);
+    break;
+  case SYS_MSYNC:
+    f->a0 = vm_msync(f->a0, f->a1);
+    break;
+  case SYS_MUNMAP:
+    f->a0 = vm_munmap(f->a0);
+    break;
+  case SYS_FORK:
+    f->a0 = proc_fork(f, READ_CSR(sepc) + 4);
+    break;
+  case SYS_WAIT:
+    f->a0 = proc_wait(f->a0);
+    break;
+  case SYS_TIMESLICE: {
+    // 이전 값을 리턴하고, 0이면 바꾸지 않음 (다음 슬라이스부터 적용)
+    int ms = f->a0;
+    f->a0 = time_slice_ms;
+    if (ms < 0 || ms > TIME_SLICE_MAX_MS)
+      f->a0 = -1;
+    else if (ms > 0)
+      time_slice_ms = ms;
+    break;
+  }
+  case SYS_SPAWN:
+    f->a0 = user_prepare_str(f->a0) ? proc_spawn((const char *)f->a0) : -1;
+    break;
+  case SYS_READ:
+  case SYS_WRITE: {
+    // 길이는 음수이면 안 됨 (fs_read/fs_write는 부호 없는 길이를 받음)
+    int count = f->a2;
+    if (count < 0) {
+      f->a0 = -1;
+      break;
+    }
+
+    // 버퍼가 mmap 영역이면 커널이 접근하기 전에 페이지를 채워 둠
+    struct open_file *of = fd_get(f->a0);
+    if (!of || !user_prepare(f->a1, count, f->a3 == SYS_READ)) {
+      f->a0 = -1;
+      break;
+    }
+
+    // 오프셋이 걸친 섹터만 읽고 씀
+    void *buf = (void *)f->a1;
+    int len;
+    if (f->a3 == SYS_WRITE) {
+      len = fs_write(of->file, of->offset, buf, count);
+      if (len > 0)
+        fs_mark_dirty(of->file);
+    } else {
+      len = fs_read(of->file, of->offset, buf, count);
+    }
+
+    if (len > 0)
+      of->offset += len;
+    f->a0 = len;
+    break;
+  }
   case SYS_READFILE:
   case SYS_WRITEFILE: {
     const char *filename = (const char *)f->a0;
     char *buf = (char *)f->a1;
     int len = f->a2;
+    if (len < 0 || !user_prepare_str(f->a0)) {
+      f->a0 = -1;
+      break;
+    }
+
     struct file *file = fs_lookup(filename);
+
+    // 쓰기 요청인데 파일이 없으면 새로 만듦
+    if (!file && f->a3 == SYS_WRITEFILE)
+      file = fs_create(filename);
     if (!file) {
       printf("file not found: %s\n", filename);
       f->a0 = -1;
       break;
     }
+    if (!user_prepare(f->a1, len, f->a3 == SYS_READFILE)) {
+      f->a0 = -1;
+      break;
+    }
 
-    if (len > (int)sizeof(file->data))
-      len = file->size;
+    // 잘라 내기 전에 새 내용이 들어갈 수 있는지 먼저 확인
+    // (fs_write가 실패하면 기존 내용만 잃게 됨)
+    if (f->a3 == SYS_WRITEFILE &&
+        ((uint32_t)len > FILE_SIZE_MAX ||
+         fs_used_sectors - fs_file_sectors(file->size) + fs_file_sectors(len) + 1 >
+             blk_capacity / SECTOR_SIZE)) {
+      f->a0 = -1;
+      break;
+    }
 
+    // 디스크를 기다리며 잠든 사이 파일이 삭제되지 않도록 사용 중으로 표시
+    file->open_count++;
     if (f->a3 == SYS_WRITEFILE) {
-      memcpy(file->data, buf, len);
-      file->size = len;
-      fs_flush();
+      // 파일 전체를 새 내용으로 바꿈 (기존 페이지를 디스크에서 읽을 필요 없음)
+      fs_truncate(file, 0);
+      len = fs_write(file, 0, buf, len);
+      fs_mark_dirty(file); // 디스크 기록은 flusher 스레드가 나중에 묶어서 처리
     } else {
-      memcpy(buf, file->data, len);
+      len = fs_read(file, 0, buf, len);
     }
+    file->open_count--;
 
     f->a0 = len;
     break;
@@ -577,13 +3188,50 @@ void handle_trap(struct trap_frame *f) {
   // 트랩이 발생한 명령어의 주소 (예외가 일어난 시점의 PC)
   uint32_t user_pc = READ_CSR(sepc);
 
-  // 시스템 콜인 경우
-  if (scause == SCAUSE_ECALL) {
+  // 타이머 인터럽트: 타임 슬라이스를 다 쓴 프로세스를 선점
+  // 사용자 모드의 레지스터는 kernel_entry에서 trap_frame에 모두 저장되어
+  // 있으므로 그대로 다른 프로세스로 전환했다가 돌아오면 됨
+  if (scause == (SCAUSE_INTERRUPT | IRQ_S_TIMER)) {
+    sched_stats.timer_irqs++;
+    fs_timer_tick();
+    yield();
+  } else if (scause == (SCAUSE_INTERRUPT | IRQ_S_EXTERNAL)) {
+    // 외부 인터럽트: 깨어난 프로세스의 우선순위가 더 높으면 바로 양보
+    plic_handle_irq();
+    if (runqueue_has_higher(current_proc->priority))
+      yield();
+  } else if (READ_CSR(sstatus) & SSTATUS_SPP) {
+    // 커널 모드에서 난 예외는 복구할 수 없음
+    if (stval >= KSTACK_BASE &&
+        stval < KSTACK_BASE + PROCS_MAX * KSTACK_STRIDE &&
+        (stval - KSTACK_BASE) % KSTACK_STRIDE < PAGE_SIZE)
+      PANIC("kernel stack overflow (pid %d, sepc=%x)", current_proc->pid,
+            user_pc);
+    PANIC("unexpected trap in kernel scause=%x, stval=%x, sepc=%x\n", scause,
+          stval, user_pc);
+  } else if (scause == SCAUSE_INST_PAGE_FAULT ||
+             scause == SCAUSE_LOAD_PAGE_FAULT ||
+             scause == SCAUSE_STORE_PAGE_FAULT) {
+    // 페이지를 채웠으면 같은 명령어부터 다시 실행
+    uint32_t access = scause == SCAUSE_INST_PAGE_FAULT    ? PAGE_X
+                      : scause == SCAUSE_STORE_PAGE_FAULT ? PAGE_W
+                                                          : PAGE_R;
+    if (!vm_fault(stval, access)) {
+      printf("process %d: segmentation fault at %x (sepc=%x)\n",
+             current_proc->pid, stval, user_pc);
+      vm_stats.kills++;
+      proc_exit();
+    }
+  } else if (scause == SCAUSE_ECALL) {
+    // 시스템 콜인 경우
     handle_syscall(f);
     user_pc += 4;
   } else {
-    PANIC("unexpected trap scause=%x, stval=%x, sepc=%x\n", scause, stval,
-          user_pc);
+    // 잘못된 명령어 등 사용자 프로그램의 오류는 해당 프로세스만 종료
+    printf("process %d: unexpected trap scause=%x, stval=%x, sepc=%x\n",
+           current_proc->pid, scause, stval, user_pc);
+    vm_stats.kills++;
+    proc_exit();
   }
 
   WRITE_CSR(sepc, user_pc);
@@ -612,12 +3260,27 @@ void virtio_reg_fetch_and_or32(unsigned offset, uint32_t value) {
 
 // 블록 장치에 요청을 전송하기 위한 가상 큐 포인터
 struct virtio_virtq *blk_request_vq;
-// 블록 장치 요청 구조체로, 읽기/쓰기 명령과 관련 데이터를 포함
-struct virtio_blk_req *blk_req;
-// 블록 요청 구조체의 물리 주소
-paddr_t blk_req_paddr;
+// 블록 장치 요청 구조체 풀, 요청의 헤드 디스크립터 번호로 인덱싱
+struct virtio_blk_req *blk_reqs;
+// 요청 구조체 풀의 물리 주소
+paddr_t blk_reqs_paddr;
+// 진행 중인 요청의 상태, 헤드 디스크립터 번호로 인덱싱
+struct blk_request blk_requests[VIRTQ_ENTRY_NUM];
+// 사용 가능한 디스크립터 목록 (descs[i].next로 연결)
+uint16_t blk_desc_free_head;
+unsigned blk_desc_nfree;
+// 요청별 데이터 버퍼 영역 (헤드 디스크립터 번호마다 한 페이지)
+paddr_t blk_bounce_paddr;
 // 블록 장치의 총 용량(바이트 단위)
 unsigned blk_capacity;
+// 장치가 허용하는 데이터 디스크립터 하나의 최대 크기와 요청당 최대 개수
+uint32_t blk_size_max;
+uint32_t blk_seg_max;
+// 요청 하나로 주고받을 수 있는 최대 섹터 수
+unsigned blk_max_sectors;
+// 요청 완료나 빈 디스크립터를 기다리는 프로세스들
+struct proc_queue blk_waiters;
+struct blk_stats blk_stats;
 
 void virtio_blk_init(void) {
   // 0x74726976은 ASCII로 "virv"이며, VirtIO 장치임을 확인하는 매직값
@@ -635,7 +3298,10 @@ void virtio_blk_init(void) {
   virtio_reg_fetch_and_or32(VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACK);
   // 3. DRIVER 상태 비트를 설정
   virtio_reg_fetch_and_or32(VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_DRIVER);
-  // 4. FEATURES_OK 상태 비트를 설정
+  // 4. 기능 협상: 데이터 디스크립터 크기/개수 제한만 받아들이고 FEATURES_OK 설정
+  uint32_t features = virtio_reg_read32(VIRTIO_REG_DEVICE_FEATURES) &
+                      (VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX);
+  virtio_reg_write32(VIRTIO_REG_DRIVER_FEATURES, features);
   virtio_reg_fetch_and_or32(VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FEAT_OK);
   // 5. 장치별 설정 수행 (예, virtqueue 검색)
   blk_request_vq = virtq_init(0);
@@ -646,10 +3312,42 @@ void virtio_blk_init(void) {
   blk_capacity = virtio_reg_read64(VIRTIO_REG_DEVICE_CONFIG + 0) * SECTOR_SIZE;
   printf("virtio-blk: capacity is %d bytes\n", blk_capacity);
 
-  // 장치에 요청(request)을 저장할 영역 할당
-  blk_req_paddr =
-      alloc_pages(align_up(sizeof(*blk_req), PAGE_SIZE) / PAGE_SIZE);
-  blk_req = (struct virtio_blk_req *)blk_req_paddr;
+  // 장치 설정 공간의 size_max(+8), seg_max(+12) 읽기
+  // 제한이 없으면 디스크립터 수만큼 (헤더와 상태 디스크립터 2개 제외) 허용
+  blk_size_max = (features & VIRTIO_BLK_F_SIZE_MAX)
+                     ? virtio_reg_read32(VIRTIO_REG_DEVICE_CONFIG + 8)
+                     : PAGE_SIZE;
+  blk_seg_max = (features & VIRTIO_BLK_F_SEG_MAX)
+                    ? virtio_reg_read32(VIRTIO_REG_DEVICE_CONFIG + 12)
+                    : VIRTQ_ENTRY_NUM - 2;
+  if (blk_size_max < SECTOR_SIZE || blk_size_max > PAGE_SIZE)
+    blk_size_max = PAGE_SIZE;
+  if (blk_seg_max == 0 || blk_seg_max > VIRTQ_ENTRY_NUM - 2)
+    blk_seg_max = VIRTQ_ENTRY_NUM - 2;
+
+  blk_size_max = blk_size_max / SECTOR_SIZE * SECTOR_SIZE;
+  blk_max_sectors = blk_size_max * blk_seg_max / SECTOR_SIZE;
+  if (blk_max_sectors > BLK_MAX_SECTORS)
+    blk_max_sectors = BLK_MAX_SECTORS;
+  printf("virtio-blk: size_max=%d seg_max=%d, up to %d sectors per request\n",
+         blk_size_max, blk_seg_max, blk_max_sectors);
+
+  // 모든 디스크립터를 free list에 연결
+  for (int i = 0; i < VIRTQ_ENTRY_NUM; i++)
+    blk_request_vq->descs[i].next = i + 1;
+  blk_desc_free_head = 0;
+  blk_desc_nfree = VIRTQ_ENTRY_NUM;
+
+  // 장치에 요청(request)을 저장할 영역 할당 (동시에 진행 가능한 최대 개수만큼)
+  blk_reqs_paddr = alloc_pages(
+      align_up(sizeof(*blk_reqs) * VIRTQ_ENTRY_NUM, PAGE_SIZE) / PAGE_SIZE);
+  blk_reqs = (struct virtio_blk_req *)blk_reqs_paddr;
+
+  // 직접 DMA가 불가능할 때 쓸 요청별 bounce 버퍼 할당
+  // (요청 하나가 최대 한 페이지를 주고받음)
+  blk_bounce_paddr = alloc_pages(VIRTQ_ENTRY_NUM);
+  for (int i = 0; i < VIRTQ_ENTRY_NUM; i++)
+    blk_requests[i].bounce = (uint8_t *)(blk_bounce_paddr + i * PAGE_SIZE);
 }
 
 // desc_index는 새로운 요청의 디스크립터 체인의 헤드 디스크립터 인덱스
@@ -662,12 +3360,84 @@ void virtq_kick(struct virtio_virtq *vq, int desc_index) {
   __sync_synchronize();
 
   virtio_reg_write32(VIRTIO_REG_QUEUE_NOTIFY, vq->queue_index);
-  vq->last_used_index++;
 }
 
-// 장치가 요청을 처리 중인지 확인
-bool virtq_is_busy(struct virtio_virtq *vq) {
-  return vq->last_used_index != *vq->used_index;
+// free list에서 디스크립터 하나를 꺼냄 (호출 전에 남은 개수를 확인해야 함)
+uint16_t blk_desc_alloc(void) {
+  uint16_t i = blk_desc_free_head;
+  blk_desc_free_head = blk_request_vq->descs[i].next;
+  blk_desc_nfree--;
+  return i;
+}
+
+// 헤드 디스크립터부터 체인 전체를 free list로 반환
+void blk_desc_free_chain(uint16_t head) {
+  struct virtq_desc *descs = blk_request_vq->descs;
+  uint16_t i = head;
+  while (true) {
+    bool has_next = descs[i].flags & VIRTQ_DESC_F_NEXT;
+    uint16_t next = descs[i].next;
+    descs[i].flags = 0;
+    descs[i].next = blk_desc_free_head;
+    blk_desc_free_head = i;
+    blk_desc_nfree++;
+    if (!has_next)
+      break;
+    i = next;
+  }
+}
+
+// used ring에 새로 추가된 완료 항목을 한꺼번에 회수하고 기다리는 프로세스를 깨움
+void virtio_blk_reap(void) {
+  struct virtio_virtq *vq = blk_request_vq;
+
+  // 장치가 쓴 used ring 내용을 인덱스를 확인한 뒤에 읽도록 보장
+  __sync_synchronize();
+  if (vq->last_used_index == *vq->used_index)
+    return;
+
+  // used ring의 id는 완료된 요청의 헤드 디스크립터 번호
+  while (vq->last_used_index != *vq->used_index) {
+    struct virtq_used_elem *e =
+        &vq->used.ring[vq->last_used_index % VIRTQ_ENTRY_NUM];
+    struct blk_request *r = &blk_requests[e->id];
+    r->done = true;
+    vq->last_used_index++;
+
+    // 비동기 요청은 여기서 바로 마무리
+    if (r->on_done)
+      r->on_done(r);
+  }
+
+  proc_wakeup_all(&blk_waiters);
+}
+
+// virtio-blk 인터럽트 처리: 인터럽트를 확인(ack)하고 완료된 요청을 회수
+void virtio_blk_intr(void) {
+  uint32_t status = virtio_reg_read32(VIRTIO_REG_INTERRUPT_STATUS);
+  virtio_reg_write32(VIRTIO_REG_INTERRUPT_ACK, status);
+  blk_stats.irqs++;
+  virtio_blk_reap();
+}
+
+// 요청 완료나 디스크립터 반환을 한 번 기다림
+// 프로세스 문맥이면 인터럽트가 깨워줄 때까지 잠들고, 부팅 중처럼 잠들 수 없으면
+// used ring을 직접 폴링
+void blk_wait(void) {
+  if (current_proc && current_proc != idle_proc) {
+    blk_stats.sleeps++;
+    proc_sleep(&blk_waiters);
+  } else {
+    virtio_blk_reap();
+  }
+}
+
+// 블록 장치 통계 출력
+void blk_dump_stats(void) {
+  printf("blk: requests=%d sectors=%d bounced=%d irqs=%d sleeps=%d "
+         "max_inflight=%d\n",
+         blk_stats.requests, blk_stats.sectors, blk_stats.bounced,
+         blk_stats.irqs, blk_stats.sleeps, blk_stats.max_inflight);
 }
 
 /**
@@ -697,59 +3467,508 @@ struct virtio_virtq *virtq_init(unsigned index) {
   return vq;
 }
 
-// virtio-blk 장치로부터 읽기/쓰기를 수행
-void read_write_disk(void *buf, unsigned sector, int is_write) {
-  if (sector >= blk_capacity / SECTOR_SIZE) {
+// 디스크립터가 부족하지 않아 바로 요청을 제출할 수 있는지 확인
+bool blk_can_submit(unsigned ndescs) { return blk_desc_nfree >= ndescs; }
+
+// len 바이트의 데이터를 담는 요청에 필요한 디스크립터 수 (헤더, 상태 포함)
+unsigned blk_descs_needed(uint32_t len) {
+  return 2 + (len + blk_size_max - 1) / blk_size_max;
+}
+
+// DMA 구간 목록에 [paddr, paddr + len)을 추가
+// 바로 앞 구간과 물리적으로 이어지면 size_max를 넘지 않는 선에서 합침
+bool blk_dma_push(struct blk_dma_range *ranges, int *n, int max, paddr_t paddr,
+                  uint32_t len) {
+  while (len > 0) {
+    struct blk_dma_range *last = *n > 0 ? &ranges[*n - 1] : NULL;
+    uint32_t take;
+    if (last && last->paddr + last->len == paddr && last->len < blk_size_max) {
+      take = blk_size_max - last->len;
+      if (take > len)
+        take = len;
+      last->len += take;
+    } else {
+      if (*n == max)
+        return false;
+      take = len < blk_size_max ? len : blk_size_max;
+      ranges[(*n)++] = (struct blk_dma_range){.paddr = paddr, .len = take};
+    }
+
+    paddr += take;
+    len -= take;
+  }
+
+  return true;
+}
+
+/**
+ * @brief 버퍼 조각들을 장치가 직접 접근할 물리 주소 구간들로 변환
+ * 커널 영역은 일대일 매핑이라 그대로 연속이지만, 사용자 버퍼처럼 페이지마다
+ * 물리 주소가 다를 수 있는 경우는 페이지 경계에서 구간을 나눔
+ *
+ * @return int 구간 수 (seg_max를 넘거나 매핑되지 않은 페이지가 있으면 -1)
+ */
+int blk_map_segs(struct blk_seg *segs, int nsegs,
+                 struct blk_dma_range *ranges) {
+  uint32_t *table1 = current_proc ? current_proc->page_table : kernel_page_table;
+  int n = 0;
+  for (int i = 0; i < nsegs; i++) {
+    vaddr_t vaddr = (vaddr_t)segs[i].buf;
+    uint32_t remaining = segs[i].len;
+    while (remaining > 0) {
+      uint32_t chunk = PAGE_SIZE - (vaddr & (PAGE_SIZE - 1));
+      if (chunk > remaining)
+        chunk = remaining;
+
+      paddr_t paddr = virt_to_phys(table1, vaddr);
+      if (!paddr || !blk_dma_push(ranges, &n, blk_seg_max, paddr, chunk))
+        return -1;
+
+      vaddr += chunk;
+      remaining -= chunk;
+    }
+  }
+
+  return n;
+}
+
+/**
+ * @brief 여러 섹터의 읽기/쓰기 요청을 디스크립터 체인 하나로 제출
+ * 완료를 기다리지 않고 리턴하며, 디스크립터가 부족하면 다른 요청이 끝날 때까지
+ * 대기. 데이터 디스크립터는 호출한 쪽의 버퍼를 직접 가리키므로 복사가 없음
+ * (zero-copy). 물리적으로 흩어진 구간이 seg_max보다 많을 때만 요청별 bounce
+ * 버퍼를 거침
+ *
+ * @param sector 시작 섹터 번호
+ * @param segs 데이터 버퍼 조각 목록 (각 길이는 SECTOR_SIZE의 배수)
+ * @param nsegs 버퍼 조각 수
+ * @param is_write 쓰기 요청 여부
+ * @return struct blk_request* 완료를 기다릴 때 사용할 요청 (실패 시 NULL)
+ */
+struct blk_request *blk_submit_sg(unsigned sector, struct blk_seg *segs,
+                                  int nsegs, int is_write) {
+  uint32_t len = 0;
+  for (int i = 0; i < nsegs; i++)
+    len += segs[i].len;
+
+  unsigned count = len / SECTOR_SIZE;
+  if (nsegs > BLK_SEGS_MAX || len % SECTOR_SIZE != 0 || count == 0 ||
+      count > blk_max_sectors)
+    PANIC("virtio: invalid request (%d segs, %d bytes)", nsegs, len);
+
+  if (sector + count > blk_capacity / SECTOR_SIZE) {
     printf("virtio: tried to read/write sector=%d, but capacity is %d\n",
-           sector, blk_capacity / SECTOR_SIZE);
-    return;
+           sector + count - 1, blk_capacity / SECTOR_SIZE);
+    return NULL;
   }
 
-  // virtio-blk 사양에 따라 요청을 구성
-  blk_req->sector = sector;
-  blk_req->type = is_write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
-  if (is_write)
-    memcpy(blk_req->data, buf, SECTOR_SIZE);
+  // 버퍼를 물리 주소 구간으로 변환, 불가능하면 bounce 버퍼 사용
+  struct blk_dma_range ranges[VIRTQ_ENTRY_NUM - 2];
+  int nranges = blk_map_segs(segs, nsegs, ranges);
+  bool bounced = nranges < 0;
 
-  // virtqueue 디스크립터를 구성 (3개의 디스크립터 사용)
-  struct virtio_virtq *vq = blk_request_vq;
-  vq->descs[0].addr = blk_req_paddr;
-  vq->descs[0].len = sizeof(uint32_t) * 2 + sizeof(uint64_t);
-  vq->descs[0].flags = VIRTQ_DESC_F_NEXT;
-  vq->descs[0].next = 1;
+  unsigned ndescs = bounced ? blk_descs_needed(len) : (unsigned)nranges + 2;
+  while (!blk_can_submit(ndescs))
+    blk_wait();
+
+  // 요청 상태 기록 (요청 버퍼는 헤드 디스크립터 번호로 선택)
+  uint16_t head = blk_desc_alloc();
+  struct blk_request *r = &blk_requests[head];
+  for (int i = 0; i < nsegs; i++)
+    r->segs[i] = segs[i];
+  r->nsegs = nsegs;
+  r->sector = sector;
+  r->count = count;
+  r->is_write = is_write;
+  r->bounced = bounced;
+  r->done = false;
+  r->on_done = NULL;
 
-  vq->descs[1].addr = blk_req_paddr + offsetof(struct virtio_blk_req, data);
-  vq->descs[1].len = SECTOR_SIZE;
-  vq->descs[1].flags = VIRTQ_DESC_F_NEXT | (is_write ? 0 : VIRTQ_DESC_F_WRITE);
-  vq->descs[1].next = 2;
+  if (bounced) {
+    // 쓰기 요청이면 버퍼 조각들을 bounce 버퍼로 모음 (gather)
+    if (is_write) {
+      uint32_t off = 0;
+      for (int i = 0; i < nsegs; i++) {
+        memcpy(r->bounce + off, segs[i].buf, segs[i].len);
+        off += segs[i].len;
+      }
+    }
+
+    nranges = 0;
+    blk_dma_push(ranges, &nranges, VIRTQ_ENTRY_NUM - 2, (paddr_t)r->bounce,
+                 len);
+    blk_stats.bounced++;
+  }
+
+  // virtio-blk 사양에 따라 요청 헤더를 구성
+  struct virtio_blk_req *req = &blk_reqs[head];
+  paddr_t req_paddr = blk_reqs_paddr + head * sizeof(*req);
+  req->sector = sector;
+  req->type = is_write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  req->status = 0xff;
+
+  // virtqueue 디스크립터 체인을 구성 (헤더 -> 데이터 조각들 -> 상태)
+  struct virtq_desc *descs = blk_request_vq->descs;
+  descs[head].addr = req_paddr;
+  descs[head].len = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+  descs[head].flags = VIRTQ_DESC_F_NEXT;
+
+  uint16_t prev = head;
+  for (int i = 0; i < nranges; i++) {
+    uint16_t d = blk_desc_alloc();
+    descs[prev].next = d;
+    descs[d].addr = ranges[i].paddr;
+    descs[d].len = ranges[i].len;
+    descs[d].flags = VIRTQ_DESC_F_NEXT | (is_write ? 0 : VIRTQ_DESC_F_WRITE);
+    prev = d;
+  }
 
-  vq->descs[2].addr = blk_req_paddr + offsetof(struct virtio_blk_req, status);
-  vq->descs[2].len = sizeof(uint8_t);
-  vq->descs[2].flags = VIRTQ_DESC_F_WRITE;
+  uint16_t d = blk_desc_alloc();
+  descs[prev].next = d;
+  descs[d].addr = req_paddr + offsetof(struct virtio_blk_req, status);
+  descs[d].len = sizeof(uint8_t);
+  descs[d].flags = VIRTQ_DESC_F_WRITE;
 
   // 장치에 새로운 요청이 있음을 알림
-  virtq_kick(vq, 0);
+  virtq_kick(blk_request_vq, head);
 
-  // 장치가 요청 처리를 마칠 때까지 대기(바쁜 대기; busy-wait)
-  while (virtq_is_busy(vq))
-    ;
+  blk_stats.requests++;
+  blk_stats.sectors += count;
+  if (++blk_stats.inflight > blk_stats.max_inflight)
+    blk_stats.max_inflight = blk_stats.inflight;
+  return r;
+}
+
+/**
+ * @brief 제출한 요청이 끝날 때까지 기다린 뒤 결과를 처리하고 디스크립터를 반환
+ *
+ * @param r blk_submit_sg가 반환한 요청
+ */
+bool blk_complete(struct blk_request *r) {
+  if (!r)
+    return false;
+
+  // 장치가 요청 처리를 마칠 때까지 대기 (완료 인터럽트가 깨워줌)
+  while (!*(volatile bool *)&r->done)
+    blk_wait();
+
+  uint16_t head = r - blk_requests;
+  struct virtio_blk_req *req = &blk_reqs[head];
+  bool ok = req->status == 0;
 
   // virtio-blk: 0이 아닌 값이 반환되면 에러
-  if (blk_req->status != 0) {
-    printf("virtio: warn: failed to read/write sector=%d status=%d\n", sector,
-           blk_req->status);
-    return;
+  if (!ok) {
+    printf("virtio: warn: failed to read/write sector=%d status=%d\n",
+           r->sector, req->status);
+  } else if (r->bounced && !r->is_write) {
+    // bounce 버퍼로 읽은 경우, 데이터를 버퍼 조각들에 나눠 복사 (scatter)
+    uint32_t off = 0;
+    for (int i = 0; i < r->nsegs; i++) {
+      memcpy(r->segs[i].buf, r->bounce + off, r->segs[i].len);
+      off += r->segs[i].len;
+    }
+  }
+
+  // 디스크립터를 반환하고, 빈 디스크립터를 기다리는 프로세스를 깨움
+  blk_stats.inflight--;
+  blk_desc_free_chain(head);
+  proc_wakeup_all(&blk_waiters);
+  return ok;
+}
+
+/**
+ * @brief 완료를 기다리지 않는 읽기 요청 (선읽기 등)
+ * 디스크립터가 부족하면 기다리지 않고 포기하며, 완료되면 on_done이 호출됨
+ * (on_done에서 blk_complete로 요청을 마무리해야 함)
+ *
+ * @return struct blk_request* 제출한 요청 (제출하지 못했으면 NULL)
+ */
+struct blk_request *blk_read_async(void *buf, unsigned sector, unsigned count,
+                                   void (*on_done)(struct blk_request *r),
+                                   void *ctx) {
+  if (!blk_can_submit(blk_descs_needed(count * SECTOR_SIZE)))
+    return NULL;
+
+  struct blk_seg seg = {.buf = buf, .len = count * SECTOR_SIZE};
+  struct blk_request *r = blk_submit_sg(sector, &seg, 1, false);
+  if (!r)
+    return NULL; // 용량을 벗어난 요청
+  r->on_done = on_done;
+  r->ctx = ctx;
+  return r;
+}
+
+// virtio-blk 장치로부터 읽기/쓰기를 수행
+void read_write_disk(void *buf, unsigned sector, int is_write) {
+  struct blk_seg seg = {.buf = buf, .len = SECTOR_SIZE};
+  blk_complete(blk_submit_sg(sector, &seg, 1, is_write));
+}
+
+/**
+ * @brief 연속된 여러 섹터를 읽기/쓰기
+ * 장치가 허용하는 최대 크기(blk_max_sectors)로 나눈 다중 섹터 요청들을
+ * 디스크립터가 허용하는 만큼 먼저 모두 제출해 두고 (파이프라이닝)
+ * 가장 오래된 요청부터 완료를 기다리며 빈자리에 다음 요청을 채움
+ *
+ * @param buf 섹터 데이터 버퍼 (count * SECTOR_SIZE 바이트)
+ * @param sector 시작 섹터 번호
+ * @param count 섹터 수
+ * @param is_write 쓰기 요청 여부
+ */
+void read_write_disk_batch(uint8_t *buf, unsigned sector, unsigned count,
+                           int is_write) {
+  struct blk_request *inflight[VIRTQ_ENTRY_NUM];
+  unsigned inflight_count[VIRTQ_ENTRY_NUM]; // 각 요청의 섹터 수
+  unsigned submitted = 0, completed = 0;    // 섹터 단위 진행 상황
+  unsigned head = 0, tail = 0;           // inflight 배열의 요청 단위 위치
+
+  while (completed < count) {
+    // 자신이 진행 중인 요청이 없을 때만 디스크립터를 기다리며 잠듦
+    // (진행 중인 요청이 있다면 그것을 먼저 완료해야 디스크립터가 돌아옴)
+    while (submitted < count) {
+      unsigned n = count - submitted;
+      if (n > blk_max_sectors)
+        n = blk_max_sectors;
+      if (head != tail && !blk_can_submit(blk_descs_needed(n * SECTOR_SIZE)))
+        break;
+
+      struct blk_seg seg = {.buf = &buf[submitted * SECTOR_SIZE],
+                            .len = n * SECTOR_SIZE};
+      inflight[tail % VIRTQ_ENTRY_NUM] =
+          blk_submit_sg(sector + submitted, &seg, 1, is_write);
+      inflight_count[tail++ % VIRTQ_ENTRY_NUM] = n;
+      submitted += n;
+    }
+
+    blk_complete(inflight[head % VIRTQ_ENTRY_NUM]);
+    completed += inflight_count[head++ % VIRTQ_ENTRY_NUM];
+  }
+}
+
+struct buf bcache[BCACHE_SIZE];               // 섹터 버퍼들
+struct buf *bcache_buckets[BCACHE_BUCKETS];   // 섹터 번호 해시 테이블
+struct buf bcache_lru;                        // LRU 리스트의 머리 (sentinel)
+struct proc_queue bcache_waiters;             // I/O 중인 버퍼를 기다리는 큐
+struct bcache_stats bcache_stats;             // 버퍼 캐시 통계
+
+// LRU 리스트에서 버퍼를 떼어냄
+void bcache_lru_remove(struct buf *b) {
+  b->prev->next = b->next;
+  b->next->prev = b->prev;
+}
+
+// 버퍼를 LRU 리스트의 맨 앞(가장 최근에 사용)에 넣음
+void bcache_lru_push_front(struct buf *b) {
+  b->next = bcache_lru.next;
+  b->prev = &bcache_lru;
+  bcache_lru.next->prev = b;
+  bcache_lru.next = b;
+}
+
+// 버퍼 캐시 초기화: 모든 버퍼를 비어있는 상태로 LRU 리스트에 연결
+void bcache_init(void) {
+  bcache_lru.prev = bcache_lru.next = &bcache_lru;
+  for (int i = 0; i < BCACHE_SIZE; i++) {
+    bcache[i].sector = BCACHE_NO_SECTOR;
+    bcache_lru_push_front(&bcache[i]);
+  }
+}
+
+// 해시 테이블에서 섹터를 담은 버퍼를 찾음
+struct buf *bcache_find(unsigned sector) {
+  for (struct buf *b = bcache_buckets[sector % BCACHE_BUCKETS]; b; b = b->hnext)
+    if (b->sector == sector)
+      return b;
+  return NULL;
+}
+
+// 해시 테이블에서 버퍼를 제거
+void bcache_hash_remove(struct buf *b) {
+  struct buf **link = &bcache_buckets[b->sector % BCACHE_BUCKETS];
+  while (*link != b)
+    link = &(*link)->hnext;
+  *link = b->hnext;
+}
+
+// 버퍼의 I/O가 끝날 때까지 대기 (부팅 중에는 경쟁하는 프로세스가 없음)
+void bcache_wait(void) {
+  if (current_proc)
+    proc_sleep(&bcache_waiters);
+}
+
+// 버퍼 하나를 디스크에 다시 씀
+void bcache_write_back(struct buf *b) {
+  b->busy = true;
+  read_write_disk(b->data, b->sector, true);
+  b->busy = false;
+  b->dirty = false;
+  bcache_stats.writebacks++;
+  proc_wakeup_all(&bcache_waiters);
+}
+
+/**
+ * @brief 섹터를 담을 버퍼를 찾거나 할당해 참조를 얻음 (디스크에서 읽지 않음)
+ * 캐시에 없으면 참조되지 않은 버퍼 중 가장 오래전에 사용한 것을 교체하며,
+ * 그 버퍼가 dirty이면 먼저 디스크에 기록. 내용 전체를 덮어쓸 때 사용
+ *
+ * @param sector 섹터 번호
+ * @return struct buf* 참조를 얻은 버퍼 (새로 할당했다면 valid가 false)
+ */
+struct buf *bget(unsigned sector) {
+  for (;;) {
+    struct buf *b = bcache_find(sector);
+    if (b) {
+      if (b->busy) {
+        bcache_wait();
+        continue;
+      }
+
+      b->refcnt++;
+      return b;
+    }
+
+    // LRU 리스트의 뒤쪽부터 교체할 버퍼를 찾음
+    struct buf *victim = NULL;
+    for (b = bcache_lru.prev; b != &bcache_lru; b = b->prev) {
+      if (b->refcnt == 0 && !b->busy) {
+        victim = b;
+        break;
+      }
+    }
+
+    if (!victim)
+      PANIC("bcache: no free buffers");
+
+    // dirty 버퍼는 기록한 뒤 다시 찾음 (기록 중 다른 프로세스가 캐시를 바꿀 수
+    // 있음)
+    if (victim->dirty) {
+      bcache_write_back(victim);
+      continue;
+    }
+
+    if (victim->sector != BCACHE_NO_SECTOR) {
+      bcache_hash_remove(victim);
+      bcache_stats.evictions++;
+    }
+
+    victim->sector = sector;
+    victim->valid = false;
+    victim->refcnt = 1;
+    victim->hnext = bcache_buckets[sector % BCACHE_BUCKETS];
+    bcache_buckets[sector % BCACHE_BUCKETS] = victim;
+    return victim;
+  }
+}
+
+// 섹터 내용을 담은 버퍼의 참조를 얻음 (캐시에 없으면 디스크에서 읽음)
+struct buf *bread(unsigned sector) {
+  struct buf *b = bget(sector);
+  if (b->valid) {
+    bcache_stats.hits++;
+    return b;
+  }
+
+  bcache_stats.misses++;
+  b->busy = true;
+  read_write_disk(b->data, sector, false);
+  b->busy = false;
+  b->valid = true;
+  proc_wakeup_all(&bcache_waiters);
+  return b;
+}
+
+// 버퍼 내용이 바뀌었음을 표시 (bflush나 교체 시 디스크에 기록)
+void bdirty(struct buf *b) {
+  b->valid = true;
+  b->dirty = true;
+}
+
+// 버퍼의 참조를 반환하고, 참조가 없어지면 LRU 리스트의 맨 앞으로 옮김
+void brelse(struct buf *b) {
+  if (--b->refcnt == 0) {
+    bcache_lru_remove(b);
+    bcache_lru_push_front(b);
+  }
+}
+
+/**
+ * @brief dirty 버퍼들을 모두 디스크에 기록
+ * 섹터 번호 순으로 정렬해 연속된 섹터들을 scatter-gather 요청 하나로 묶고,
+ * 요청들을 파이프라이닝으로 제출
+ */
+void bflush(void) {
+  // dirty 버퍼를 모아 섹터 번호 순으로 정렬 (삽입 정렬)
+  struct buf *dirty[BCACHE_SIZE];
+  int n = 0;
+  for (int i = 0; i < BCACHE_SIZE; i++) {
+    struct buf *b = &bcache[i];
+    if (!b->dirty || b->busy)
+      continue;
+
+    int j = n++;
+    for (; j > 0 && dirty[j - 1]->sector > b->sector; j--)
+      dirty[j] = dirty[j - 1];
+    dirty[j] = b;
+    b->busy = true;
+  }
+
+  unsigned max_segs = blk_max_sectors < BLK_SEGS_MAX ? blk_max_sectors
+                                                     : BLK_SEGS_MAX;
+  struct blk_request *inflight[VIRTQ_ENTRY_NUM];
+  unsigned head = 0, tail = 0; // inflight 배열의 요청 단위 위치
+  int next = 0;                // 다음에 제출할 dirty 버퍼 위치
+  while (next < n || head != tail) {
+    // 연속된 섹터들을 한 요청으로 묶어 제출
+    while (next < n) {
+      int count = 1;
+      while (next + count < n && (unsigned)count < max_segs &&
+             dirty[next + count]->sector == dirty[next]->sector + count)
+        count++;
+      if (head != tail &&
+          !blk_can_submit(blk_descs_needed(count * SECTOR_SIZE)))
+        break;
+
+      struct blk_seg segs[BLK_SEGS_MAX];
+      for (int i = 0; i < count; i++)
+        segs[i] = (struct blk_seg){.buf = dirty[next + i]->data,
+                                   .len = SECTOR_SIZE};
+      inflight[tail++ % VIRTQ_ENTRY_NUM] =
+          blk_submit_sg(dirty[next]->sector, segs, count, true);
+      next += count;
+    }
+
+    blk_complete(inflight[head++ % VIRTQ_ENTRY_NUM]);
+  }
+
+  for (int i = 0; i < n; i++) {
+    dirty[i]->busy = false;
+    dirty[i]->dirty = false;
+  }
+  bcache_stats.writebacks += n;
+  proc_wakeup_all(&bcache_waiters);
+}
+
+// 섹터를 담은 버퍼가 있으면 버림 (버퍼 캐시를 거치지 않고 디스크에 직접 쓸 때
+// 캐시에 남은 이전 내용과 어긋나지 않도록)
+void binval(unsigned sector) {
+  struct buf *b = bcache_find(sector);
+  if (b && b->refcnt == 0 && !b->busy) {
+    bcache_hash_remove(b);
+    b->sector = BCACHE_NO_SECTOR;
+    b->valid = false;
+    b->dirty = false;
   }
+}
 
-  // 읽기 작업의 경우, 데이터를 버퍼에 복사
-  if (!is_write)
-    memcpy(buf, blk_req->data, SECTOR_SIZE);
+// 버퍼 캐시 통계 출력
+void bcache_dump_stats(void) {
+  printf("bcache: hits=%d misses=%d evictions=%d writebacks=%d\n",
+         bcache_stats.hits, bcache_stats.misses, bcache_stats.evictions,
+         bcache_stats.writebacks);
 }
 
 // 파일 시스템의 파일 테이블
 struct file files[FILES_MAX];
-// 디스크 이미지를 메모리에 로드하기 위한 버퍼
-uint8_t disk[DISK_MAX_SIZE];
 
 /**
  * @brief 8진수(octal) 문자열을 10진수(decimal) 정수로 변환
@@ -769,41 +3988,66 @@ int oct2int(char *oct, int len) {
 }
 
 // 파일 시스템 초기화
-// 1. 전체 디스크 내용을 메모리에 로드
+// 1. 버퍼 캐시를 통해 헤더 섹터를 읽음
 // 2. TAR 형식의 헤더를 순차적으로 파싱
-// 3. 각 파일의 메타데이터(이름, 크기 등)을 추출
-// 4. 파일 데이터를 메모리 내 파일 시스템 구조에 로드
+// 3. 각 파일의 메타데이터(이름, 크기, 위치)를 추출
+// 4. 파일 데이터는 읽지 않고 헤더의 크기만큼 건너뜀 (처음 접근할 때 읽음)
 // 5. 모든 파일을 처리하거나 비어있는 헤더를 만나면 초기화 완료
+// 마운트 시간은 디스크 크기가 아니라 파일 수에 비례
 void fs_init(void) {
-  // 디스크 데이터 로드
-  for (unsigned sector = 0; sector < sizeof(disk) / SECTOR_SIZE; sector++)
-    read_write_disk(&disk[sector * SECTOR_SIZE], sector, false);
+  uint64_t start = read_time();
+  uint32_t sectors_read = blk_stats.sectors;
+
+  fs_index_init();
 
   // TAR 파일 구조 파싱
-  unsigned off = 0;
-  for (int i = 0; i < FILES_MAX; i++) {
+  unsigned sector = 0;
+  int nfiles = 0;
+  for (; nfiles < FILES_MAX && sector < blk_capacity / SECTOR_SIZE; nfiles++) {
 
     // TAR 파일 헤더 검사
-    struct tar_header *header = (struct tar_header *)&disk[off];
-    if (header->name[0] == '\0')
+    struct buf *b = bread(sector);
+    struct tar_header *header = (struct tar_header *)b->data;
+    if (header->name[0] == '\0') {
+      brelse(b);
       break;
+    }
 
     // TAR 포맷 검증
     if (strcmp(header->magic, "ustar") != 0)
       PANIC("invalid tar header: magix=\"%s\"", header->magic);
 
     // 파일 크기 추출 및 파일 정보 저장
+    // 페이지 색인이 가리킬 수 있는 크기여야 하고 데이터가 디스크 안에 있어야 함
     int filesz = oct2int(header->size, sizeof(header->size));
-    struct file *file = &files[i];
+    if ((uint32_t)filesz > FILE_SIZE_MAX ||
+        sector + fs_file_sectors(filesz) > blk_capacity / SECTOR_SIZE)
+      PANIC("invalid tar entry: %s (%d bytes)", header->name, filesz);
+    struct file *file = &files[nfiles];
     file->in_use = true;
     strcpy(file->name, header->name);
-    memcpy(file->data, header->data, filesz);
+    file->hash = fs_name_hash(file->name);
     file->size = filesz;
-    printf("file: %s, size=%d\n", file->name, file->size);
+    file->disk_size = filesz;
+    file->sector = sector;
+    fs_index_insert(file);
+    brelse(b);
 
-    // 다음 파일 헤더로 이동
-    off += align_up(sizeof(struct tar_header) + filesz, SECTOR_SIZE);
+    // 데이터 섹터들을 건너뛰고 다음 파일 헤더로 이동
+    sector += fs_file_sectors(filesz);
   }
+
+  fs_end_sector = sector;
+  fs_used_sectors = sector;
+  fs_last_used = nfiles - 1;
+  for (int i = nfiles; i < FILES_MAX; i++)
+    fs_slot_mark(i, true);
+
+  // 파일마다 콘솔에 출력하면 파일 수가 많을 때 마운트보다 오래 걸리므로
+  // 요약만 출력 (time CSR, QEMU virt 기준 10MHz)
+  printf("fs: mounted %d files (%d sectors) in %d ticks, read %d sectors\n",
+         nfiles, sector, (uint32_t)(read_time() - start),
+         blk_stats.sectors - sectors_read);
 }
 
 // 커널 메인 함수
@@ -813,6 +4057,9 @@ void kernel_main(void) {
    * 하려면 수동으로 초기화 하는 것이 안전 */
   memset(__bss, 0, (size_t)__bss_end - (size_t)__bss);
 
+  // 부팅 시간 측정 시작 (셸 프로세스를 만들 때까지)
+  uint64_t boot_start = read_time();
+
   printf("\n\n");
 
   /*
@@ -824,24 +4071,64 @@ void kernel_main(void) {
    */
   WRITE_CSR(stvec, (uint32_t)kernel_entry);
 
+  /* 타이머 인터럽트 활성화
+   * 커널(S 모드)에서는 sstatus.SIE가 0이므로 인터럽트가 발생하지 않고,
+   * 사용자 모드로 돌아간 순간에만 인터럽트가 걸려 프로세스를 선점
+   * 외부 인터럽트(PLIC)는 UART 입력 등 장치 이벤트를 알려줌 */
+  WRITE_CSR(sie, READ_CSR(sie) | SIE_STIE | SIE_SEIE);
+
+  pages_init();
+  pages_dump_stats();
+  kernel_vm_init();
+  asid_init();
+
+  plic_init();
+  uart_init();
   virtio_blk_init();
+  bcache_init();
   fs_init();
 
-  char buf[SECTOR_SIZE];
-  read_write_disk(buf, 0, false /* read from the disk */);
-  printf("first sector: %s\n", buf);
+  // fs_flush는 바뀐 파일의 섹터만 다시 쓰므로, 첫 번째 파일의 헤더를
+  // 덮어쓰지 않고 읽기만 함
+  struct buf *b = bread(0);
+  printf("first sector: %s\n", b->data);
+  brelse(b);
 
-  strcpy(buf, "hello from kernel!!!\n");
-  read_write_disk(buf, 0, true /* write to the disk */);
-
-  idle_proc = create_process(NULL, 0);
+  proc_init();
+  idle_proc = create_process(NULL, NULL);
   idle_proc->pid = 0; // idle
   current_proc = idle_proc;
 
-  create_process(_binary_shell_bin_start, (size_t)_binary_shell_bin_size);
+  // 프로세스 생성 비용 측정 (time CSR, QEMU virt 기준 10MHz)
+  uint32_t spawn_start = READ_CSR(time);
+  struct image *shell = image_load((const uint8_t *)_binary_shell_elf_start,
+                                   (size_t)_binary_shell_elf_size);
+  if (!shell)
+    PANIC("invalid shell image");
+  create_process(shell, user_entry);
+  printf("spawn: shell created in %d ticks\n",
+         (uint32_t)READ_CSR(time) - spawn_start);
+  printf("boot: %d ticks\n", (uint32_t)(read_time() - boot_start));
 
-  yield();
-  PANIC("switched to idle process");
+  // 지연된 파일 쓰기를 기록하는 커널 스레드
+  create_kernel_thread(fs_flusher_entry);
+
+  /* idle 루프
+   * 실행 가능한 프로세스가 없을 때만 여기로 돌아옴. 커널은 sstatus.SIE가 0이라
+   * 트랩으로 인터럽트를 받지 않으므로, wfi로 인터럽트가 대기 상태가 될 때까지
+   * 쉰 뒤 sip를 보고 직접 처리하고 깨어난 프로세스로 전환 */
+  for (;;) {
+    schedule();
+    __asm__ __volatile__("wfi");
+
+    uint32_t sip = READ_CSR(sip);
+    if (sip & SIP_SEIP)
+      plic_handle_irq();
+    if (sip & SIP_STIP) {
+      fs_timer_tick();
+      timer_stop();
+    }
+  }
 
   /*
     Hello World 메시지가 화면에 출력되는 과정 SBI 호출 시, 문자는 다음과 같이
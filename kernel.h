@@ -1,16 +1,17 @@
 #pragma once
 #include "common.h"
 
-#define FILES_MAX 2
-// #define DISK_MAX_SIZE align_up(sizeof(struct file) * FILES_MAX, SECTOR_SIZE)
+#define FILES_MAX 1024
+
+// 파일 이름 색인 (open addressing 해시 테이블) 관련 매크로
+#define FS_INDEX_SIZE (FILES_MAX * 2) // 2의 거듭제곱, 항상 절반 이상 비어 있음
+#define FS_INDEX_EMPTY -1             // 한 번도 쓰지 않은 칸
+#define FS_INDEX_DELETED -2           // 삭제된 칸 (탐색은 계속 진행)
+#define FS_INDEX_DELETED_MAX (FS_INDEX_SIZE / 4) // 넘으면 색인을 다시 만듦
 
 #define ALIGN_UP(x, align) (((x) + (align) - 1) & ~((align) - 1))
-#define DISK_MAX_SIZE ALIGN_UP(sizeof(struct file) * FILES_MAX, SECTOR_SIZE)
 #define SSTATUS_SUM (1 << 18)
 
-// #define ALIGN_UP(x, align) (((x) + (align) - 1) & ~((align) - 1))
-// #define DISK_MAX_SIZE ALIGN_UP(sizeof(struct file) * FILES_MAX, SECTOR_SIZE)
-
 /* tar 파일은 아래와 같은 구조
   +----------------+
   |   tar header   |
@@ -46,23 +47,95 @@ struct tar_header {
   char data[];        // 가변 크기 배열, 실제 파일 데이터는 헤더 이후 위치
 } __attribute__((packed));
 
+// 지연 쓰기(write-back) 관련 매크로
+#define FS_FLUSH_DELAY_MS 500  // 첫 쓰기 후 디스크에 기록하기까지의 지연 시간
+#define FS_DIRTY_THRESHOLD 8   // 기록을 미루지 않고 바로 시작할 쓰기 횟수
+#define FS_FLUSH_BATCH 16      // fs_flush가 잠금을 한 번 잡고 기록하는 최대 페이지 수
+#define FS_RECLAIM_BATCH 16    // 할당에 실패했을 때 한 번에 회수할 페이지 캐시 수
+
+// 파일 시스템 통계
+struct fs_stats {
+  uint32_t writes;  // writefile 호출 수
+  uint32_t flushes; // 디스크에 기록한 횟수 (여러 쓰기를 한 번에 묶음)
+  uint32_t syncs;   // fsync 호출 수
+  uint32_t sector_loads; // 디스크에서 페이지 캐시로 읽어 온 섹터 수
+  uint32_t ra_sectors;   // 선읽기로 미리 읽어 온 섹터 수
+  uint32_t evictions;    // 메모리가 모자라 회수한 페이지 캐시 페이지 수
+};
+
+// 파일 내용은 페이지 단위로 캐시하며, 페이지 색인은 2단계로 구성
+// 디렉터리(페이지 1개)가 색인 페이지들을 가리키고, 색인 페이지 하나가
+// FILE_INDEX_ENTRIES개의 페이지를 가리킴 (색인 페이지는 접근한 범위만 할당)
+#define FILE_INDEX_ENTRIES (PAGE_SIZE / sizeof(paddr_t))
+#define FILE_DIR_ENTRIES 256 // 디렉터리 엔트리 수 (최대 파일 크기 1GB)
+#define FILE_PAGES_MAX (FILE_DIR_ENTRIES * FILE_INDEX_ENTRIES)
+#define FILE_SIZE_MAX (FILE_PAGES_MAX * PAGE_SIZE)
+
+// 페이지 색인의 엔트리: 상위 비트는 페이지의 물리 주소, 하위 비트는 페이지
+// 안에서 디스크로부터 읽어 온(유효한) 섹터들의 비트맵
+#define FILE_PAGE_SECTORS (PAGE_SIZE / SECTOR_SIZE)
+#define FILE_PAGE_VALID_ALL ((1u << FILE_PAGE_SECTORS) - 1)
+#define FILE_PAGE_RA (1u << FILE_PAGE_SECTORS) // 선읽기 요청이 진행 중인 페이지
+#define FILE_PAGE_DIRTY (1u << (FILE_PAGE_SECTORS + 1)) // 기록 이후 바뀐 페이지
+#define FILE_PAGE_ADDR(entry) ((entry) & ~(PAGE_SIZE - 1))
+
+// 순차 읽기 선읽기(readahead) 관련 매크로
+#define FS_RA_MIN_SECTORS 8  // 순차 읽기를 감지했을 때 처음 선읽기 창의 크기
+#define FS_RA_MAX_SECTORS 64 // 선읽기 창의 최대 크기 (순차 읽기가 이어지면 2배씩)
+#define FS_RA_SLOTS 8        // 동시에 진행할 수 있는 선읽기 요청 수
+
 struct file {
   bool in_use;
   char name[100];
-  char data[1024];
-  size_t size;
+  uint32_t hash;    // 파일 이름의 해시 값 (색인에서 비교할 때 사용)
+  size_t size;      // 파일 크기 (메모리에서 바뀐 내용 포함)
+  size_t disk_size; // sector 위치에 기록되어 있는 데이터 크기
+  unsigned sector;  // 디스크에서 TAR 헤더가 위치한 섹터 번호
+  bool dirty;       // 마지막 fs_flush 이후 내용이 바뀌었는지 여부
+  int open_count;   // 파일을 사용 중인 파일 디스크립터/시스템 콜 수
+  int map_count;    // 파일을 매핑한 mmap 영역 수 (페이지 캐시를 반환하지 않음)
+  uint32_t version; // 내용이 바뀔 때마다 새로 받는 번호 (실행 이미지 캐시 검증)
+  uint32_t ra_next;   // 순차 읽기라면 다음 읽기가 시작될 위치
+  uint32_t ra_window; // 현재 선읽기 창의 크기 (섹터 단위, 0이면 선읽기 안 함)
+  paddr_t *pages;   // 페이지 캐시 색인의 디렉터리 (fs_page_entry 참고)
+  bool flushing;          // fs_flush가 새 위치로 옮기는 중인지 여부
+  unsigned flush_sector;  // 옮기는 중인 새 헤더 위치
+  uint32_t flushed_lo;    // 새 위치에 이미 기록한 데이터 범위의 시작 (바이트)
+  uint32_t flushed_hi;    // 새 위치에 이미 기록한 데이터 범위의 끝 (바이트)
 };
 
+// PLIC(Platform-Level Interrupt Controller) 관련 매크로, QEMU virt 기준
+// hart 0의 S 모드 컨텍스트(컨텍스트 1)만 사용
+#define PLIC_PADDR 0x0c000000
+#define PLIC_PRIORITY(irq) (PLIC_PADDR + (irq) * 4) // 인터럽트별 우선순위
+#define PLIC_SENABLE (PLIC_PADDR + 0x2080)          // 인터럽트 활성화 비트
+#define PLIC_STHRESHOLD (PLIC_PADDR + 0x201000)     // 우선순위 임계값
+#define PLIC_SCLAIM (PLIC_PADDR + 0x201004)         // 인터럽트 claim/complete
+
+// UART(ns16550a) 관련 매크로
+#define UART0_PADDR 0x10000000 // UART 레지스터의 물리 주소
+#define UART0_IRQ 10           // UART의 PLIC 인터럽트 번호
+#define UART_RBR 0             // 수신 버퍼 레지스터
+#define UART_IER 1             // 인터럽트 활성화 레지스터
+#define UART_LSR 5             // 라인 상태 레지스터
+#define UART_IER_RX 1          // 수신 데이터 인터럽트
+#define UART_LSR_DR 1          // 수신 데이터 있음
+
+#define CONSOLE_BUF_SIZE 128 // 콘솔 입력 링 버퍼 크기
+
 // virtio 관련 매크로
 #define SECTOR_SIZE 512    // 디스크 섹터 크기 512바이트
 #define VIRTQ_ENTRY_NUM 16 // 가상 큐 엔트리 수 16개
 
 #define VIRTIO_DEVICE_BLK 2         // virtio 블록 디바이스의 ID
 #define VIRTIO_BLK_PADDR 0x10001000 // virtio 블록 디바이스의 물리적 주소
+#define VIRTIO_BLK_IRQ 1            // virtio 블록 디바이스의 PLIC 인터럽트 번호
 
 #define VIRTIO_REG_MAGIC 0x00     // virtio 디바이스의 매직 넘버 레지스터 오프셋
 #define VIRTIO_REG_VERSION 0x04   // virtio 디바이스의 버전 정보 레지스터 오프셋
 #define VIRTIO_REG_DEVICE_ID 0x08 // 디바이스 ID 레지스터 오프셋
+#define VIRTIO_REG_DEVICE_FEATURES 0x10 // 장치가 제공하는 기능 비트
+#define VIRTIO_REG_DRIVER_FEATURES 0x20 // 드라이버가 사용할 기능 비트
 #define VIRTIO_REG_QUEUE_SEL 0x30 // 큐 선택 레지스터 오프셋
 #define VIRTIO_REG_QUEUE_NUM_MAX 0x34  // 큐의 최대 크기 레지스터 오프셋
 #define VIRTIO_REG_QUEUE_NUM 0x38      // 큐 크기 설정 레지스터 오프셋
@@ -70,6 +143,8 @@ struct file {
 #define VIRTIO_REG_QUEUE_PFN 0x40      // 큐의 물리적 페이지 프레임 번호
 #define VIRTIO_REG_QUEUE_READY 0x44    // 큐 준비 상태
 #define VIRTIO_REG_QUEUE_NOTIFY 0x50   // 큐 알림
+#define VIRTIO_REG_INTERRUPT_STATUS 0x60 // 인터럽트 원인
+#define VIRTIO_REG_INTERRUPT_ACK 0x64    // 인터럽트 처리 완료 알림
 #define VIRTIO_REG_DEVICE_STATUS 0x70  // 디바이스 상태
 #define VIRTIO_REG_DEVICE_CONFIG 0x100 // 디바이스 설정
 
@@ -85,6 +160,9 @@ struct file {
 #define VIRTIO_BLK_T_IN 0  // 블록 디바이스에서 데이터를 읽음
 #define VIRTIO_BLK_T_OUT 1 // 블록 디바이스에 데이터를 씀
 
+#define VIRTIO_BLK_F_SIZE_MAX (1 << 1) // 디스크립터 하나의 최대 크기 제한
+#define VIRTIO_BLK_F_SEG_MAX (1 << 2)  // 요청 하나의 최대 데이터 조각 수 제한
+
 // virtqueue 디스크립터 엔트리
 struct virtq_desc {
   uint64_t addr;  // 버퍼의 물리적 주소
@@ -131,16 +209,98 @@ struct virtio_blk_req {
   uint32_t reserved; // 예약된 필드
   uint64_t sector;   // 접근하려는 디스크 섹터 번호
 
-  // 두 번째 디스크립터: 읽기 작업 시, 장치가 데이터를 쓰도록 허용
-  uint8_t data[512]; // 데이터 버퍼
+  // 중간 디스크립터들: 데이터 버퍼 (요청마다 따로 할당, 여러 개로 나뉠 수 있음)
 
-  // 세 번째 디스크립터: 장치가 쓸 수 있는 상태 정보 영역
+  // 마지막 디스크립터: 장치가 쓸 수 있는 상태 정보 영역
   uint8_t status; // 작업의 결과 상태
 } __attribute__((packed));
 
+// 블록 요청 하나가 다룰 수 있는 최대 섹터 수와 버퍼 조각 수
+#define BLK_MAX_SECTORS (PAGE_SIZE / SECTOR_SIZE)
+#define BLK_SEGS_MAX 8
+
+// 블록 요청의 데이터 버퍼 조각 (scatter-gather 목록의 원소)
+struct blk_seg {
+  void *buf;    // 버퍼 주소
+  uint32_t len; // 버퍼 길이 (SECTOR_SIZE의 배수)
+};
+
+// 장치가 직접 접근(DMA)할 물리적으로 연속된 메모리 구간
+struct blk_dma_range {
+  paddr_t paddr; // 구간의 물리 주소
+  uint32_t len;  // 구간의 길이
+};
+
+// 진행 중인 블록 요청의 상태 (헤드 디스크립터 번호로 찾음)
+struct blk_request {
+  struct blk_seg segs[BLK_SEGS_MAX]; // 요청한 쪽의 데이터 버퍼 목록
+  int nsegs;                         // 버퍼 조각 수
+  uint8_t *bounce;                   // 직접 DMA가 불가능할 때 거치는 버퍼
+  bool bounced;                      // bounce 버퍼를 거치는 요청인지 여부
+  unsigned sector;                   // 시작 섹터 번호
+  unsigned count;                    // 섹터 수
+  bool is_write;                     // 쓰기 요청 여부
+  bool done; // 장치가 처리를 마쳐 used ring에서 회수되었는지 여부
+  // 완료를 기다리는 쪽이 없는 비동기 요청의 완료 콜백 (used ring에서 회수할
+  // 때 호출되며, 잠들면 안 됨)
+  void (*on_done)(struct blk_request *r);
+  void *ctx; // 콜백에 넘길 데이터
+};
+
+// 블록 장치 통계
+struct blk_stats {
+  uint32_t requests;     // 제출한 요청 수
+  uint32_t sectors;      // 요청으로 주고받은 섹터 수
+  uint32_t bounced;      // bounce 버퍼를 거친 요청 수
+  uint32_t irqs;         // virtio 인터럽트 수
+  uint32_t sleeps;       // 완료를 기다리며 잠든 횟수
+  uint32_t inflight;     // 현재 진행 중인 요청 수
+  uint32_t max_inflight; // 동시에 진행 중이던 요청 수의 최댓값
+};
+
+// 버퍼 캐시 관련 매크로
+#define BCACHE_SIZE 32               // 캐시할 수 있는 섹터 수
+#define BCACHE_BUCKETS 16            // 섹터 번호 해시 테이블의 버킷 수
+#define BCACHE_NO_SECTOR 0xffffffff  // 아무 섹터도 담지 않은 버퍼
+
+// 디스크 섹터 하나를 캐시하는 버퍼
+struct buf {
+  unsigned sector; // 담고 있는 섹터 번호
+  bool valid;      // data가 섹터 내용을 담고 있는지 여부
+  bool dirty;      // 디스크에 다시 써야 하는지 여부
+  bool busy;       // 장치와 I/O 중인지 여부
+  int refcnt;      // 버퍼를 사용 중인 참조 수 (0일 때만 교체 가능)
+  struct buf *hnext;       // 같은 해시 버킷의 다음 버퍼
+  struct buf *prev, *next; // LRU 리스트 (앞쪽일수록 최근에 사용)
+  uint8_t data[SECTOR_SIZE];
+};
+
+// 버퍼 캐시 통계
+struct bcache_stats {
+  uint32_t hits;       // 캐시에서 바로 찾은 횟수
+  uint32_t misses;     // 디스크에서 읽어야 했던 횟수
+  uint32_t evictions;  // 다른 섹터를 위해 버퍼를 교체한 횟수
+  uint32_t writebacks; // 디스크에 다시 쓴 dirty 섹터 수
+};
+
 // 예외 트랩 핸들러
 #define SCAUSE_ECALL 8
-#define PROC_EXITED 2
+#define SCAUSE_INST_PAGE_FAULT 12  // 명령어 페이지 폴트
+#define SCAUSE_LOAD_PAGE_FAULT 13  // 읽기 페이지 폴트
+#define SCAUSE_STORE_PAGE_FAULT 15 // 쓰기 페이지 폴트
+#define PROC_EXITED 2 // 종료했지만 부모가 아직 회수하지 않은 프로세스 (좀비)
+#define SCAUSE_INTERRUPT (1u << 31) // scause 최상위 비트: 인터럽트 여부
+#define IRQ_S_TIMER 5               // 슈퍼바이저 타이머 인터럽트 번호
+#define SIE_STIE (1 << 5)           // sie: 타이머 인터럽트 활성화
+#define IRQ_S_EXTERNAL 9            // 슈퍼바이저 외부 인터럽트 번호 (PLIC)
+#define SIE_SEIE (1 << 9)           // sie: 외부 인터럽트 활성화
+#define SIP_STIP (1 << 5)           // sip: 타이머 인터럽트 대기 중
+#define SIP_SEIP (1 << 9)           // sip: 외부 인터럽트 대기 중
+
+// 타이머 관련 매크로
+#define TIMEBASE_FREQ 10000000 // time CSR 주파수 (QEMU virt: 10MHz)
+#define TIME_SLICE_MS 10       // 기본 타임 슬라이스 (ms)
+#define TIME_SLICE_MAX_MS 1000 // timeslice 시스템 콜로 설정할 수 있는 최댓값
 
 // Sv32 방식의 페이지 테이블
 #define SATP_SV32 (1u << 31) // Sv32 모드 페이징 활성화
@@ -149,18 +309,239 @@ struct virtio_blk_req {
 #define PAGE_W (1 << 2)      // 쓰기 가능
 #define PAGE_X (1 << 3)      // 실행 가능
 #define PAGE_U (1 << 4)      // 사용자 모드 접근 가능
+#define PAGE_G (1 << 5)      // 전역 매핑 (모든 주소 공간에서 공유, ASID 무시)
+#define PAGE_COW (1 << 8)    // 쓰기 시 복사할 공유 페이지 (소프트웨어용 RSW 비트)
+
+// satp 레지스터의 ASID(Address Space ID) 필드 (22~30번 비트, 최대 9비트)
+#define SATP_ASID_SHIFT 22
+#define SATP_ASID_MASK (0x1ffu << SATP_ASID_SHIFT)
+
+// 1단계 엔트리에 R/W/X 비트가 있으면 4MB 메가페이지(leaf)로 동작
+#define MEGAPAGE_SIZE (4 * 1024 * 1024)
 
 // 애플리케이션 이미지의 기본 가상 주소
 #define USER_BASE 0x1000000
+// 사용자 이미지, bss, 스택이 들어가는 영역의 끝 (user.ld의 제한과 같음)
+#define USER_END 0x1800000
+
+/* 커널 스택 영역
+ * 프로세스마다 KSTACK_STRIDE 크기의 칸을 하나씩 쓰며, 칸의 첫 페이지는 매핑하지
+ * 않는 가드 페이지로 남겨 스택이 넘치면 다른 프로세스의 스택을 덮어쓰지 않고
+ * 페이지 폴트가 나게 함. 전역 매핑이므로 모든 주소 공간에서 같은 주소 */
+#define KSTACK_BASE 0x40000000
+#define KSTACK_SIZE (2 * PAGE_SIZE)             // 커널 스택 크기
+#define KSTACK_STRIDE (KSTACK_SIZE + PAGE_SIZE) // 가드 페이지 + 스택
+
+// 같은 크기의 객체를 페이지 단위로 모아 할당하는 slab 할당자
+// 각 페이지의 앞부분에 struct slab이 있고 그 뒤에 객체들이 이어짐
+struct slab {
+  struct slab *next; // 빈 객체가 남은 slab 목록에서 다음 slab
+  struct slab *prev; // 빈 객체가 남은 slab 목록에서 이전 slab
+  void *free;        // 빈 객체 목록 (객체의 첫 워드에 다음 빈 객체를 저장)
+  uint32_t used;     // 사용 중인 객체 수
+};
+
+struct slab_cache {
+  uint32_t obj_size;    // 객체 크기 (8바이트 단위로 올림)
+  struct slab *partial; // 빈 객체가 남은 slab 목록
+  uint32_t pages;       // 할당받은 페이지 수
+  uint32_t objs;        // 사용 중인 객체 수
+};
+
+/* 버디(buddy) 방식의 물리 페이지 할당자
+ * 2^order 페이지 크기의 블록을 order별 free list로 관리
+ * 블록을 해제할 때 짝(buddy) 블록도 비어 있으면 한 단계 큰 블록으로 병합 */
+#define PAGE_ORDER_MAX 10 // 최대 블록 크기: 2^10 페이지 (4MB)
+
+#define PG_FREE (1 << 0)       // free list에 들어있는 블록의 첫 페이지
+#define PG_REFERENCED (1 << 1) // 최근에 사용된 페이지 캐시 페이지 (회수를 한 번 미룸)
+#define PG_LOCKED (1 << 2)     // 디스크 I/O가 진행 중인 페이지 캐시 페이지
+
+// 물리 페이지 하나당 하나씩 존재하는 메타데이터
+struct page {
+  struct page *next; // 같은 order의 free list에서 다음 블록 (페이지 캐시는 LRU)
+  struct page *prev; // 같은 order의 free list에서 이전 블록 (페이지 캐시는 LRU)
+  uint8_t order;     // 블록의 order (블록의 첫 페이지에서만 유효)
+  uint8_t flags;     // PG_FREE 등
+  uint16_t refs;     // 페이지를 매핑한 페이지 테이블 수 (사용자 페이지만 사용)
+  struct file *file; // 페이지 캐시 페이지가 속한 파일 (아니면 NULL)
+  uint32_t idx;      // 파일 내 페이지 번호 (페이지 캐시 페이지만 사용)
+};
+
+// 페이지 할당자 통계 (단편화 관찰용)
+struct page_stats {
+  uint32_t total_pages; // 관리 중인 전체 페이지 수
+  uint32_t free_pages;  // 남은 페이지 수
+  uint32_t used_pages;  // 할당된 페이지 수
+  uint32_t alloc_calls; // alloc_pages 호출 횟수
+  uint32_t free_calls;  // free_pages 호출 횟수
+  uint32_t free_blocks[PAGE_ORDER_MAX + 1]; // order별 free 블록 수
+};
 
 #define SSTATUS_SPIE (1 << 5)
+#define SSTATUS_SPP (1 << 8) // 트랩 직전의 모드 (1이면 커널 모드)
+
+// 페이지 폴트 처리 통계
+struct vm_stats {
+  uint32_t faults;       // 처리한 페이지 폴트 수
+  uint32_t zero_fills;   // 0으로 채운 페이지를 매핑한 횟수 (bss, 스택)
+  uint32_t image_copies; // 이미지에서 복사한 페이지를 매핑한 횟수
+  uint32_t text_shares;  // 공유하는 읽기 전용 이미지 페이지를 매핑한 횟수
+  uint32_t text_loads;   // 공유할 읽기 전용 이미지 페이지를 새로 만든 횟수
+  uint32_t spawns;       // 파일에서 실행한 프로세스 수
+  uint32_t image_hits;   // 캐시된 이미지를 그대로 사용한 횟수
+  uint32_t image_reads;  // 파일에서 이미지를 새로 읽은 횟수
+  uint32_t image_evicts; // 캐시에서 내보낸 이미지 수
+  uint32_t file_maps;    // 파일의 페이지 캐시를 매핑한 횟수 (mmap)
+  uint32_t forks;        // fork 횟수
+  uint32_t cow_copies;   // 쓰기 시 복사한 페이지 수
+  uint32_t cow_reuses;   // 마지막 참조라 복사 없이 쓰기를 허용한 페이지 수
+  uint32_t kills;        // 잘못된 접근으로 종료시킨 프로세스 수
+};
+
+// TLB/ASID 통계
+struct tlb_stats {
+  uint32_t switches;     // 페이지 테이블 전환 횟수
+  uint32_t asid_allocs;  // ASID 할당 횟수
+  uint32_t asid_flushes; // 특정 ASID만 무효화한 횟수
+  uint32_t full_flushes; // TLB 전체 무효화 횟수 (ASID 고갈 시)
+  uint32_t rollovers;    // ASID 세대 교체 횟수
+};
+
+// 스케줄러 통계
+struct sched_stats {
+  uint32_t timer_irqs; // 타임 슬라이스 만료(타이머 인터럽트) 횟수
+  uint32_t switches;   // 컨텍스트 스위치 횟수
+  uint32_t exits;      // 종료한 프로세스 수
+  uint32_t peak_procs; // 동시에 존재한 프로세스 수의 최댓값
+  uint32_t reaps;      // 회수하여 슬롯을 돌려준 프로세스 수
+};
+
+// 스케줄러 우선순위 (0이 가장 높음)
+#define PRIO_LEVELS 8
+#define PRIO_DEFAULT 4
+#define PRIO_LOWEST (PRIO_LEVELS - 1)
+
+struct process;
+
+// 프로세스 FIFO 큐 (process.next로 연결하는 intrusive 리스트)
+struct proc_queue {
+  struct process *head; // 가장 먼저 꺼낼 프로세스
+  struct process *tail; // 마지막에 추가된 프로세스
+};
+
+#define FDS_MAX 8 // 프로세스당 최대 파일 디스크립터 수
+
+// mmap 관련 매크로
+#define MMAP_BASE 0x2000000 // 파일을 매핑할 가상 주소 영역의 시작
+#define MMAP_END 0x4000000  // 파일을 매핑할 가상 주소 영역의 끝
+#define VMAS_MAX 8          // 프로세스당 최대 mmap 영역 수
+
+// 파일을 매핑한 가상 주소 영역. 페이지 캐시의 페이지를 그대로 매핑하며,
+// 페이지는 처음 접근할 때 페이지 폴트에서 채움
+struct vm_area {
+  vaddr_t start, end; // 영역의 범위 [start, end), end가 0이면 빈 칸
+  struct file *file;  // 매핑한 파일 (파일의 처음부터 매핑)
+  int prot;           // PROT_READ, PROT_WRITE의 조합
+};
+
+// 열린 파일 (파일 디스크립터가 가리키는 대상)
+struct open_file {
+  struct file *file; // 열린 파일 (NULL이면 사용하지 않는 디스크립터)
+  uint32_t offset;   // 다음에 읽고 쓸 위치
+};
+
+// ELF 실행 파일 관련 매크로
+#define ELF_MAGIC 0x464c457f // "\x7fELF" (리틀 엔디언)
+#define ELFCLASS32 1         // 32비트 ELF
+#define EM_RISCV 243         // RISC-V 아키텍처
+#define PT_LOAD 1            // 메모리에 올릴 세그먼트
+#define PF_X (1 << 0)        // 실행 가능한 세그먼트
+#define PF_W (1 << 1)        // 쓰기 가능한 세그먼트
+#define PF_R (1 << 2)        // 읽기 가능한 세그먼트
+
+// ELF 헤더
+struct elf32_ehdr {
+  uint32_t magic;     // ELF_MAGIC
+  uint8_t class;      // ELFCLASS32
+  uint8_t ident[11];  // 엔디언, 버전 등 (사용하지 않음)
+  uint16_t type;      // 파일 종류
+  uint16_t machine;   // EM_RISCV
+  uint32_t version;   // ELF 버전
+  uint32_t entry;     // 시작 주소
+  uint32_t phoff;     // 프로그램 헤더 테이블의 파일 내 위치
+  uint32_t shoff;     // 섹션 헤더 테이블의 파일 내 위치
+  uint32_t flags;     // 아키텍처별 플래그
+  uint16_t ehsize;    // ELF 헤더 크기
+  uint16_t phentsize; // 프로그램 헤더 하나의 크기
+  uint16_t phnum;     // 프로그램 헤더 수
+  uint16_t shentsize; // 섹션 헤더 하나의 크기
+  uint16_t shnum;     // 섹션 헤더 수
+  uint16_t shstrndx;  // 섹션 이름 테이블의 섹션 번호
+} __attribute__((packed));
+
+// 프로그램 헤더 (세그먼트 하나)
+struct elf32_phdr {
+  uint32_t type;   // PT_LOAD 등
+  uint32_t offset; // 세그먼트 내용의 파일 내 위치
+  uint32_t vaddr;  // 세그먼트를 올릴 가상 주소
+  uint32_t paddr;  // 물리 주소 (사용하지 않음)
+  uint32_t filesz; // 파일에 들어 있는 크기
+  uint32_t memsz;  // 메모리에서의 크기 (filesz 이후는 0으로 채움, bss)
+  uint32_t flags;  // PF_R, PF_W, PF_X의 조합
+  uint32_t align;  // 정렬
+} __attribute__((packed));
+
+// 실행 이미지 관련 매크로
+#define IMAGES_MAX 8     // 동시에 올려 둘 수 있는 실행 이미지 수
+#define IMAGE_SEGS_MAX 4 // 이미지당 최대 PT_LOAD 세그먼트 수
+#define IMAGE_PAGES_MAX ((USER_END - USER_BASE) / PAGE_SIZE)
+
+// 메모리에 올릴 세그먼트 하나
+struct image_seg {
+  vaddr_t vaddr;   // 시작 가상 주소
+  uint32_t memsz;  // 메모리에서의 크기
+  uint32_t filesz; // 파일에서 복사할 크기
+  uint32_t offset; // 파일 내 위치
+  uint32_t flags;  // 페이지 속성 (PAGE_R, PAGE_W, PAGE_X)
+};
+
+/* 여러 프로세스가 공유하는 실행 이미지 (ELF)
+ * 읽기 전용 세그먼트(text, rodata)의 페이지는 처음 접근할 때 한 번만 만들어
+ * 모든 인스턴스가 같은 물리 페이지를 매핑하고, 쓰기 가능한 세그먼트(data, bss)만
+ * 프로세스마다 복사 */
+struct image {
+  const uint8_t *data; // ELF 파일 내용 (NULL이면 빈 칸)
+  size_t size;         // ELF 파일 크기
+  vaddr_t entry;       // 시작 주소
+  struct image_seg segs[IMAGE_SEGS_MAX];
+  int nsegs;
+  paddr_t *pages; // 공유하는 읽기 전용 페이지 (USER_BASE부터의 페이지 번호 순)
+  int refs;       // 이미지를 사용하는 프로세스 수 (0이어도 캐시로 남겨 둠)
+  struct file *file; // 이미지를 읽어 온 파일 (커널에 포함된 이미지는 NULL)
+  uint32_t version;  // 읽어 올 때의 파일 버전 (다르면 캐시를 쓰지 않음)
+  uint32_t npages;   // 파일 내용을 담은 페이지 수 (file이 있을 때만 할당)
+};
 
 struct process {
   int pid;              // 프로세스 ID
-  int state;            // 프로세스 상태: PROC_UNUSED 또는 PROC_RUNNABLE
+  int state;            // 프로세스 상태: PROC_UNUSED, PROC_RUNNABLE 등
+  int priority;         // 스케줄링 우선순위 (0 ~ PRIO_LEVELS - 1)
+  struct process *next; // 실행 큐, 대기 큐 또는 빈 슬롯 목록에서 다음 프로세스
+  struct process *parent;   // 부모 프로세스 (없거나 먼저 종료했으면 NULL)
+  struct process *children; // 자식 프로세스 목록의 첫 번째
+  struct process *sibling;  // 같은 부모의 다음 자식
+  struct proc_queue wait_queue; // 자식의 종료를 기다리는 프로세스 (부모)
   vaddr_t sp;           // 스택 포인터
   uint32_t *page_table; // 프로세스 1단계 페이지 테이블
-  uint8_t stack[8192];  // 커널 스택 (CPU 레지스터, 함수 리턴 주소, 로컬 변수)
+  uint32_t asid;        // 주소 공간 ID (TLB 엔트리 태그)
+  uint32_t asid_gen;    // asid를 할당받은 세대 (세대가 바뀌면 재할당)
+  struct image *image;  // 실행 이미지 (페이지는 처음 접근할 때 매핑)
+  struct open_file fds[FDS_MAX]; // 파일 디스크립터 테이블
+  struct vm_area vmas[VMAS_MAX]; // mmap 영역
+  uint32_t kstack_slot;  // 커널 스택 영역에서 사용하는 칸 번호
+  vaddr_t kstack_top;    // 커널 스택의 최상단 (가상 주소)
+  paddr_t kstack_paddr;  // 커널 스택 페이지의 물리 주소 (연속된 페이지)
 };
 
 /**
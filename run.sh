@@ -26,18 +26,36 @@ $CC "${CFLAGS[@]}" \
   -o shell.elf \
   shell.c user.c common.c
 
-# ELF 형식의 실행 파일을 실제 메모리 내용만 포함하는 바이너리로 변환
-$OBJCOPY --set-section-flags .bss=alloc,contents -O binary shell.elf shell.bin
-$OBJCOPY -Ibinary -Oelf32-littleriscv shell.bin shell.bin.o
+# 디스크에 넣어 spawn으로 실행하는 프로그램 (커널을 다시 빌드하지 않아도 됨)
+$CC "${CFLAGS[@]}" \
+  -Wl,-Tuser.ld \
+  -Wl,-Map=hello.map \
+  -o hello.elf \
+  hello.c user.c common.c
+
+# ELF 실행 파일을 그대로 커널에 포함 (커널이 세그먼트별 속성대로 매핑)
+# bss와 스택은 파일에 없음 (커널이 처음 접근할 때 0으로 채운 페이지를 매핑)
+$OBJCOPY -Ibinary -Oelf32-littleriscv shell.elf shell.elf.o
 
 # 커널 빌드
 $CC "${CFLAGS[@]}" \
   -Wl,-Tkernel.ld \
   -Wl,-Map=kernel.map \
   -o kernel.elf \
-  kernel.c common.c shell.bin.o
+  kernel.c common.c shell.elf.o
 
 (cd disk && tar cf ../disk.tar --format=ustar -- *.txt)
+tar rf disk.tar --format=ustar -- hello.elf
+
+# 파일이 많은 디스크 이미지로 마운트/부팅 시간을 측정할 때 사용
+# 예: BENCH_FILES=200 ./run.sh (파일마다 4KB)
+if [ -n "${BENCH_FILES:-}" ]; then
+  rm -rf bench && mkdir bench
+  for i in $(seq "$BENCH_FILES"); do
+    head -c 4096 /dev/zero | tr '\0' x > "bench/bench$i.txt"
+  done
+  (cd bench && tar rf ../disk.tar --format=ustar -- *.txt)
+fi
 
 # virt 머신 시작
 # QEMU가 제공하는 기본 펌웨어(OpenSBI)를 사용
@@ -31,11 +31,70 @@ void main(void) {
       exit();
     else if (strcmp(cmdline, "readfile") == 0) {
       char buf[128];
-      int len = readfile("hello.txt", buf, sizeof(buf));
+      int len = readfile("hello.txt", buf, sizeof(buf) - 1);
       buf[len] = '\0';
       printf("%s\n", buf);
     } else if (strcmp(cmdline, "writefile") == 0)
       writefile("hello.txt", "Hello from shell!\n", 19);
+    else if (strcmp(cmdline, "stats") == 0)
+      kstats();
+    else if (strcmp(cmdline, "sync") == 0)
+      fsync();
+    else if (strcmp(cmdline, "cat") == 0) {
+      // 파일 디스크립터로 조금씩 나눠 읽으며 출력
+      int fd = open("hello.txt", 0);
+      if (fd < 0) {
+        printf("cannot open hello.txt\n");
+        continue;
+      }
+
+      char buf[32];
+      int len;
+      while ((len = read(fd, buf, sizeof(buf) - 1)) > 0) {
+        buf[len] = '\0';
+        printf("%s", buf);
+      }
+      close(fd);
+    } else if (strcmp(cmdline, "mmap") == 0) {
+      // 파일의 페이지 캐시를 복사 없이 주소 공간에 매핑해 출력
+      int fd = open("hello.txt", 0);
+      char *p = fd < 0 ? NULL : mmap(fd, 1, PROT_READ);
+      if (!p) {
+        printf("cannot mmap hello.txt\n");
+        continue;
+      }
+
+      printf("%s", p);
+      munmap(p);
+      close(fd);
+    } else if (strcmp(cmdline, "fork") == 0) {
+      // 자식은 셸의 메모리를 공유한 채로 시작하여 쓰는 페이지만 복사됨
+      int pid = fork();
+      if (pid == 0) {
+        printf("Hello from child!\n");
+        exit();
+      } else if (pid < 0) {
+        printf("fork failed\n");
+      } else {
+        wait(pid);
+      }
+    } else if (strcmp(cmdline, "spawn") == 0) {
+      // 디스크의 프로그램 실행 (두 번째부터는 캐시된 이미지 사용)
+      int pid = spawn("hello.elf");
+      if (pid < 0)
+        printf("cannot spawn hello.elf\n");
+      else
+        wait(pid);
+    } else if (strcmp(cmdline, "slice") == 0) {
+      printf("time slice: %d ms\n", timeslice(0));
+    } else if (memcmp(cmdline, "slice ", 6) == 0) {
+      // 타임 슬라이스 길이 변경 (예: slice 50)
+      int ms = 0;
+      for (char *p = &cmdline[6]; *p >= '0' && *p <= '9'; p++)
+        ms = ms * 10 + (*p - '0');
+      if (ms == 0 || timeslice(ms) < 0)
+        printf("invalid time slice: %s\n", &cmdline[6]);
+    }
     else
       printf("unknown command: %s\n", cmdline);
   }
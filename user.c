@@ -46,6 +46,64 @@ int writefile(const char *filename, const char *buf, int len) {
   return syscall(SYS_WRITEFILE, (int)filename, (int)buf, len);
 }
 
+// 커널 내부 통계 출력
+void kstats(void) { syscall(SYS_KSTATS, 0, 0, 0); }
+
+// 지연된 파일 쓰기가 모두 디스크에 기록될 때까지 대기
+int fsync(void) { return syscall(SYS_FSYNC, 0, 0, 0); }
+
+// 파일 삭제
+int unlink(const char *filename) {
+  return syscall(SYS_UNLINK, (int)filename, 0, 0);
+}
+
+// 파일 디스크립터 기반 입출력 (오프셋을 기억하며 이어서 읽고 씀)
+int open(const char *filename, int flags) {
+  return syscall(SYS_OPEN, (int)filename, flags, 0);
+}
+
+int read(int fd, void *buf, int len) {
+  return syscall(SYS_READ, fd, (int)buf, len);
+}
+
+int write(int fd, const void *buf, int len) {
+  return syscall(SYS_WRITE, fd, (int)buf, len);
+}
+
+int lseek(int fd, int offset, int whence) {
+  return syscall(SYS_LSEEK, fd, offset, whence);
+}
+
+int close(int fd) { return syscall(SYS_CLOSE, fd, 0, 0); }
+
+// 파일을 주소 공간에 매핑 (실패하면 NULL)
+void *mmap(int fd, int len, int prot) {
+  int addr = syscall(SYS_MMAP, fd, len, prot);
+  return addr == -1 ? NULL : (void *)addr;
+}
+
+// 매핑에서 바뀐 내용을 파일에 반영하고 디스크에 기록될 때까지 대기
+int msync(void *addr, int len) { return syscall(SYS_MSYNC, (int)addr, len, 0); }
+
+// 매핑을 해제 (바뀐 내용은 다음 기록 때 파일에 반영됨)
+int munmap(void *addr) { return syscall(SYS_MUNMAP, (int)addr, 0, 0); }
+
+// 현재 프로세스를 복제 (부모에게는 자식의 pid, 자식에게는 0을 리턴)
+int fork(void) { return syscall(SYS_FORK, 0, 0, 0); }
+
+// 파일 시스템의 ELF 프로그램을 새 프로세스로 실행 (실패하면 -1)
+int spawn(const char *filename) {
+  return syscall(SYS_SPAWN, (int)filename, 0, 0);
+}
+
+// 자식 프로세스가 종료할 때까지 기다렸다가 회수 (pid가 -1이면 아무 자식이나)
+// 회수한 자식의 pid를 리턴, 기다릴 자식이 없으면 -1
+int wait(int pid) { return syscall(SYS_WAIT, pid, 0, 0); }
+
+// 타임 슬라이스 길이(ms)를 바꾸고 이전 값을 리턴 (0이면 조회만, 범위를
+// 벗어나면 -1)
+int timeslice(int ms) { return syscall(SYS_TIMESLICE, ms, 0, 0); }
+
 __attribute__((noreturn)) void exit(void) {
   syscall(SYS_EXIT, 0, 0, 0);
   for (;;)
@@ -5,4 +5,19 @@ __attribute__((noreturn)) void exit(void);
 void putchar(char ch);
 int getchar(void);
 int readfile(const char *filename, char *buf, int len);
-int writefile(const char *filename, const char *buf, int len);
\ No newline at end of file
+int writefile(const char *filename, const char *buf, int len);
+void kstats(void);
+int fsync(void);
+int unlink(const char *filename);
+int open(const char *filename, int flags);
+int read(int fd, void *buf, int len);
+int write(int fd, const void *buf, int len);
+int lseek(int fd, int offset, int whence);
+int close(int fd);
+void *mmap(int fd, int len, int prot);
+int msync(void *addr, int len);
+int munmap(void *addr);
+int fork(void);
+int spawn(const char *filename);
+int wait(int pid);
+int timeslice(int ms);
\ No newline at end of file